@@ -30,7 +30,13 @@ public:
         for (size_t i = 0; i < size; i++) {
             data[i] = other.data[i];
         }
-    } 
+    }
+
+    Vector(Vector&& other) noexcept : data(other.data), capacity(other.capacity), size(other.size) {
+        other.data = nullptr;
+        other.capacity = 0;
+        other.size = 0;
+    }
 
     Vector(std::initializer_list<T> init) : size(init.size()), capacity(init.size()) {
         data = new T[capacity];
@@ -57,6 +63,19 @@ public:
         return *this;
     }
 
+    Vector& operator=(Vector&& other) noexcept {
+        if (this != &other) {
+            delete[] data;
+            data = other.data;
+            capacity = other.capacity;
+            size = other.size;
+            other.data = nullptr;
+            other.capacity = 0;
+            other.size = 0;
+        }
+        return *this;
+    }
+
     T& operator[](size_t index) {
         return data[index];
     }
@@ -0,0 +1,352 @@
+#include "accounts.h"
+#include "auxiliary.h"
+#include "hashtable.h"
+#include "insert.h"
+#include "orderbook.h"
+#include "snapshot.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+
+struct Account {
+    double available = 0;
+    double locked = 0;
+    bool dirty = false;
+};
+
+static const double LEDGER_EPSILON = 0.000001;
+
+static mutex accountsMtx;
+static HashTable<string, Account> ledger;
+static HashTable<string, Vector<string>> userLots;
+// Растет при каждом изменении любого счета пользователя (для ETag в GET /balance)
+static HashTable<string, unsigned long> userVersions;
+static Vector<string> dirtyKeys;
+static ofstream journal;
+static string journalPath;
+
+mutex& accountsMutex() {
+    return accountsMtx;
+}
+
+static string accountKey(const string& userId, const string& lotId) {
+    return userId + ":" + lotId;
+}
+
+static Account& account(const string& userId, const string& lotId) {
+    string key = accountKey(userId, lotId);
+    if (!ledger.contains(key)) {
+        ledger.insert(key, Account());
+        if (!userLots.contains(userId)) {
+            userLots.insert(userId, Vector<string>());
+        }
+        userLots.at(userId).push_back(lotId);
+    }
+    return ledger.at(key);
+}
+
+// В журнал пишется новое значение available, а не приращение: повторное применение
+// журнала после сбоя посреди контрольной точки ничего не портит.
+static void journalAvailable(const string& userId, const string& lotId, Account& acc) {
+    if (journal.is_open()) {
+        journal << userId << "," << lotId << "," << to_string(acc.available) << "\n";
+    }
+    if (!acc.dirty) {
+        acc.dirty = true;
+        dirtyKeys.push_back(accountKey(userId, lotId));
+    }
+}
+
+static void bumpUserVersion(const string& userId) {
+    unsigned long version = userVersions.contains(userId) ? userVersions.at(userId) : 0;
+    userVersions.insert(userId, version + 1);
+}
+
+static double accountKeyBalance(const string& userId, const string& lotId) {
+    string key = accountKey(userId, lotId);
+    return ledger.contains(key) ? ledger.at(key).available : 0.0;
+}
+
+static void clampLocked(Account& acc) {
+    if (fabs(acc.locked) < LEDGER_EPSILON) {
+        acc.locked = 0;
+    }
+}
+
+// Применяет набор изменений целиком или не применяет ничего. Приращения одного счета
+// сначала суммируются, поэтому проверка на отрицательные available и locked видит итоговые значения,
+// а каждый затронутый счет попадает в журнал одной записью.
+static bool applyDeltas(const Vector<BalanceDelta>& deltas) {
+    Vector<string> keys;
+    Vector<BalanceDelta> totals;
+    for (size_t i = 0; i < deltas.get_size(); i++) {
+        const BalanceDelta& delta = deltas[i];
+        if (fabs(delta.available) < LEDGER_EPSILON && fabs(delta.locked) < LEDGER_EPSILON) {
+            continue;
+        }
+        string key = accountKey(delta.userId, delta.lotId);
+        size_t pos = 0;
+        while (pos < keys.get_size() && keys[pos] != key) {
+            pos++;
+        }
+        if (pos == keys.get_size()) {
+            keys.push_back(key);
+            totals.push_back(BalanceDelta{delta.userId, delta.lotId, 0, 0});
+        }
+        totals[pos].available += delta.available;
+        totals[pos].locked += delta.locked;
+    }
+
+    for (size_t i = 0; i < totals.get_size(); i++) {
+        string key = keys[i];
+        double available = ledger.contains(key) ? ledger.at(key).available : 0.0;
+        double locked = ledger.contains(key) ? ledger.at(key).locked : 0.0;
+        if (available + totals[i].available < -LEDGER_EPSILON || locked + totals[i].locked < -LEDGER_EPSILON) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < totals.get_size(); i++) {
+        Account& acc = account(totals[i].userId, totals[i].lotId);
+        acc.available += totals[i].available;
+        acc.locked += totals[i].locked;
+        if (fabs(acc.available) < LEDGER_EPSILON) {
+            acc.available = 0;
+        }
+        clampLocked(acc);
+        bumpUserVersion(totals[i].userId);
+        if (fabs(totals[i].available) >= LEDGER_EPSILON) {
+            journalAvailable(totals[i].userId, totals[i].lotId, acc);
+        }
+    }
+    journal.flush();
+    return true;
+}
+
+void releaseFunds(const string& userId, const string& lotId, double amount) {
+    lock_guard<mutex> lock(accountsMtx);
+    Vector<BalanceDelta> deltas;
+    deltas.push_back(BalanceDelta{userId, lotId, amount, -amount});
+    applyDeltas(deltas);
+}
+
+// Расчет по заявке: все изменения балансов участников (вместе с резервом самой заявки) применяются
+// под одной блокировкой с одной записью журнала на счет. false — available или locked какого-то
+// счета ушли бы в минус, ничего не изменено.
+bool settleBalances(const Vector<BalanceDelta>& deltas) {
+    lock_guard<mutex> lock(accountsMtx);
+    return applyDeltas(deltas);
+}
+
+double accountBalance(const string& userId, const string& lotId) {
+    lock_guard<mutex> lock(accountsMtx);
+    return accountKeyBalance(userId, lotId);
+}
+
+unsigned long accountsVersion(const string& userId) {
+    lock_guard<mutex> lock(accountsMtx);
+    return userVersions.contains(userId) ? userVersions.at(userId) : 0;
+}
+
+Vector<AccountBalance> userAccounts(const string& userId) {
+    lock_guard<mutex> lock(accountsMtx);
+    Vector<AccountBalance> result;
+    if (!userLots.contains(userId)) {
+        return result;
+    }
+
+    const Vector<string>& lots = userLots.at(userId);
+    for (size_t i = 0; i < lots.get_size(); i++) {
+        const Account& acc = ledger.at(accountKey(userId, lots[i]));
+        result.push_back(AccountBalance{lots[i], acc.available, acc.locked});
+    }
+
+    for (size_t i = 1; i < result.get_size(); i++) {
+        for (size_t j = i; j > 0 && stoll(result[j].lotId) < stoll(result[j - 1].lotId); j--) {
+            swap(result[j], result[j - 1]);
+        }
+    }
+    return result;
+}
+
+void openAccounts(const string& userId, const Vector<string>& lotIds, double initialAmount) {
+    lock_guard<mutex> lock(accountsMtx);
+    for (size_t i = 0; i < lotIds.get_size(); i++) {
+        Account& acc = account(userId, lotIds[i]);
+        acc.available += initialAmount;
+        journalAvailable(userId, lotIds[i], acc);
+    }
+    bumpUserVersion(userId);
+    journal.flush();
+}
+
+// Реестр строится из user_lot, затем поверх применяется журнал.
+// Зарезервированные суммы восстанавливаются по открытым заявкам из стакана (loadOrderBooks должен быть вызван раньше).
+void loadLedger(DatabaseManager& dbManager) {
+    lock_guard<mutex> lock(accountsMtx);
+    shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
+    Vector<Condition> cond;
+
+    int userIdx = rowColumnIndex(dbManager, "user_lot", "user_id");
+    int lotIdx = rowColumnIndex(dbManager, "user_lot", "lot_id");
+    int quantityIdx = rowColumnIndex(dbManager, "user_lot", "quantity");
+    scanSnapshot(dbManager, *snapshot, "user_lot", cond, [&](const Vector<string>& row) {
+        account(row[userIdx], row[lotIdx]).available = stod(row[quantityIdx]);
+    });
+
+    journalPath = dbManager.getSchemaName() + "/user_lot/ledger.journal";
+    ifstream in(journalPath);
+    string line;
+    size_t replayed = 0;
+    while (getline(in, line)) {
+        Vector<string> values = splitCSV(line);
+        if (values.get_size() != 3) {
+            continue; // недописанная последняя строка
+        }
+        Account& acc = account(values[0], values[1]);
+        acc.available = stod(values[2]);
+        if (!acc.dirty) {
+            acc.dirty = true;
+            dirtyKeys.push_back(accountKey(values[0], values[1]));
+        }
+        replayed++;
+    }
+    in.close();
+
+    int firstLotIdx = rowColumnIndex(dbManager, "pair", "first_lot_id");
+    int secondLotIdx = rowColumnIndex(dbManager, "pair", "second_lot_id");
+    int pairIdIdx = rowColumnIndex(dbManager, "pair", "pair_id");
+    HashTable<string, PairInfo> pairs;
+    scanSnapshot(dbManager, *snapshot, "pair", cond, [&](const Vector<string>& row) {
+        pairs.insert(row[pairIdIdx], PairInfo{row[pairIdIdx], row[firstLotIdx], row[secondLotIdx]});
+    });
+
+    bookForEachOrder([&](const string& pairId, const string& type, const BookOrder& order) {
+        if (!pairs.contains(pairId)) {
+            return;
+        }
+        const PairInfo& pair = pairs.at(pairId);
+        if (type == "buy") {
+            account(order.userId, pair.secondLotId).locked += order.quantity * order.price;
+        }
+        else {
+            account(order.userId, pair.firstLotId).locked += order.quantity;
+        }
+    });
+
+    journal.open(journalPath, ios::app);
+    if (replayed > 0) {
+        cout << "Журнал счетов: применено записей " << replayed << endl;
+    }
+}
+
+// Один проход по чанкам user_lot: каждый чанк с измененными счетами переписывается один раз.
+// Обнуленные счета удаляются из таблицы, новые дописываются через insertData. После записи журнал очищается.
+static void checkpointLocked(DatabaseManager& dbManager) {
+    if (dirtyKeys.empty()) {
+        return;
+    }
+
+    const string schema = dbManager.getSchemaName();
+    HashTable<string, bool> written;
+
+    for (int fileIndex = 1; ; fileIndex++) {
+        string csvPath = schema + "/user_lot/" + to_string(fileIndex) + ".csv";
+        ifstream in(csvPath);
+        if (!in.is_open()) {
+            break;
+        }
+
+        string header;
+        getline(in, header);
+        Vector<string> headerCols = splitCSV(header);
+        int userIdx = columnIndex(headerCols, "user_id");
+        int lotIdx = columnIndex(headerCols, "lot_id");
+        int quantityIdx = columnIndex(headerCols, "quantity");
+
+        string content = header + "\n";
+        bool changed = false;
+        string line;
+        while (getline(in, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            Vector<string> values = splitCSV(line);
+            string key = values.get_size() >= headerCols.get_size() ? accountKey(values[userIdx], values[lotIdx]) : "";
+            if (key.empty() || !ledger.contains(key) || !ledger.at(key).dirty) {
+                content += line + "\n";
+                continue;
+            }
+
+            changed = true;
+            written.insert(key, true);
+            const Account& acc = ledger.at(key);
+            if (acc.available < LEDGER_EPSILON) {
+                continue;
+            }
+            values[quantityIdx] = to_string(acc.available);
+            for (size_t i = 0; i < values.get_size(); i++) {
+                content += (i > 0 ? "," : "") + values[i];
+            }
+            content += "\n";
+        }
+        in.close();
+
+        if (changed) {
+            string tmpPath = csvPath + ".tmp";
+            ofstream out(tmpPath);
+            out << content;
+            out.close();
+            rename(tmpPath.c_str(), csvPath.c_str());
+            markChunkDirty("user_lot", fileIndex);
+            dbManager.bumpTableVersion("user_lot");
+        }
+    }
+
+    for (size_t i = 0; i < dirtyKeys.get_size(); i++) {
+        const string& key = dirtyKeys[i];
+        Account& acc = ledger.at(key);
+        acc.dirty = false;
+        if (written.contains(key) || acc.available < LEDGER_EPSILON) {
+            continue;
+        }
+
+        size_t sep = key.find(':');
+        string pkPath = schema + "/user_lot/user_lot_pk_sequence";
+        int userLotPk = 1;
+        ifstream pkFile(pkPath);
+        if (pkFile.is_open()) {
+            pkFile >> userLotPk;
+            pkFile.close();
+        }
+        string query = "VALUES('" + key.substr(0, sep) + "','" + key.substr(sep + 1) + "','" + to_string(acc.available) + "')";
+        insertData(dbManager, "user_lot", query, userLotPk);
+    }
+    dirtyKeys.clear();
+
+    journal.close();
+    journal.open(journalPath, ios::trunc);
+}
+
+void checkpointLedger(DatabaseManager& dbManager) {
+    lock_guard<mutex> lock(accountsMtx);
+    checkpointLocked(dbManager);
+}
+
+void startLedgerCheckpoints(DatabaseManager& dbManager) {
+    thread([&dbManager]() {
+        while (true) {
+            this_thread::sleep_for(chrono::milliseconds(LEDGER_CHECKPOINT_MS));
+            try {
+                checkpointLedger(dbManager);
+            }
+            catch (const exception& e) {
+                cerr << "[ERROR] Контрольная точка счетов: " << e.what() << endl;
+            }
+        }
+    }).detach();
+}
@@ -0,0 +1,43 @@
+#ifndef ACCOUNTS_H
+#define ACCOUNTS_H
+
+#include <mutex>
+#include <string>
+#include "Vector.h"
+#include "structures.h"
+
+using namespace std;
+
+// Остаток пользователя по лоту: available — свободные средства (столбец quantity в user_lot),
+// locked — зарезервированные под открытые заявки.
+struct AccountBalance {
+    string lotId;
+    double available = 0;
+    double locked = 0;
+};
+
+// Изменение одного счета в составе расчета: available и locked — приращения соответствующих сумм
+struct BalanceDelta {
+    string userId;
+    string lotId;
+    double available = 0;
+    double locked = 0;
+};
+
+// Сервис счетов: балансы хранятся в памяти (реестр), каждое изменение дописывается в журнал
+// schema/user_lot/ledger.journal, а в CSV таблицы user_lot реестр периодически сбрасывается целиком.
+const int LEDGER_CHECKPOINT_MS = 5000;
+
+void loadLedger(DatabaseManager& dbManager);
+void startLedgerCheckpoints(DatabaseManager& dbManager);
+void checkpointLedger(DatabaseManager& dbManager);
+
+void releaseFunds(const string& userId, const string& lotId, double amount);
+bool settleBalances(const Vector<BalanceDelta>& deltas);
+double accountBalance(const string& userId, const string& lotId);
+unsigned long accountsVersion(const string& userId);
+Vector<AccountBalance> userAccounts(const string& userId);
+void openAccounts(const string& userId, const Vector<string>& lotIds, double initialAmount);
+mutex& accountsMutex();
+
+#endif
@@ -4,34 +4,58 @@
 #include "select.h"
 #include "structures.h"
 #include "insert.h"
+#include "snapshot.h"
+#include "jsonwriter.h"
+#include "httpstream.h"
+#include "orderbook.h"
+#include "marketfeed.h"
+#include "executions.h"
+#include "accounts.h"
+#include "sequencer.h"
+#include "expiry.h"
+#include "orderindex.h"
+#include "lockingtable.h"
+#include "archive.h"
 #include "nlohmann/json.hpp"
+#include <chrono>
 #include <random>
 #include <shared_mutex>
 #include <mutex>
 #include <sstream>
 #include <cmath>
+#include <functional>
+#include <memory>
 
 using json = nlohmann::json;
 using namespace std;
 
 const double EPSILON = 0.000001;
+const long long MAX_FEED_TIMEOUT_MS = 30000;
+const int FEED_HEARTBEAT_MS = 15000;
+const size_t MAX_ORDER_BATCH = 100;
 
-string makeHttpResponse(int statusCode, const string& body) {
-    string statusText;
-    switch (statusCode) {
-        case 200: statusText = "OK"; break;
-        case 201: statusText = "Created"; break;
-        case 400: statusText = "Bad Request"; break;
-        case 401: statusText = "Unauthorized"; break;
-        case 403: statusText = "Forbidden"; break;
-        case 404: statusText = "Not Found"; break;
-        case 500: statusText = "Internal Server Error"; break;
-        default: statusText = "Unknown";
-    }
-    
-    return "HTTP/1.1 " + to_string(statusCode) + " " + statusText + "\r\n" + "Content-Type: application/json\r\n" + "Content-Length: " + to_string(body.size()) + "\r\n" + "\r\n" + body;
+// Движки пар работают параллельно: записи в CSV таблиц order, user, trade и order_expiry идут под
+// монопольной блокировкой таблицы из менеджера блокировок (lockingtable.cpp), так что их исключают
+// и другие потоки, и другие процессы с той же схемой. user_lot переписывает только контрольная точка реестра счетов
+
+string makeHttpResponse(int statusCode, const string& body, const string& extraHeaders) {
+    return "HTTP/1.1 " + to_string(statusCode) + " " + httpStatusText(statusCode) + "\r\n" + "Content-Type: application/json\r\n" + extraHeaders + "Content-Length: " + to_string(body.size()) + "\r\n" + "\r\n" + body;
+}
+
+// Версии таблиц начинаются заново при каждом запуске, поэтому метка включает время старта сервера
+static const long long serverStartTime = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+
+static string versionETag(const string& resource, unsigned long long version, bool pretty) {
+    return "\"" + to_string(serverStartTime) + "-" + resource + "-" + to_string(version) + (pretty ? "p" : "") + "\"";
+}
+
+// Версия таблицы в срезе совпадает с версией DatabaseManager на момент публикации
+static unsigned long snapshotTableVersion(const DatabaseSnapshot& snapshot, const string& tableName) {
+    const TableSnapshot* table = snapshot.find(tableName);
+    return table ? table->version : 0;
 }
 
+
 string getUserIdByKey(DatabaseManager& dbManager, const string& userKey) {
     try {
         Vector<string> selectCol = {"user.user_id"};
@@ -53,6 +77,24 @@ string getUserIdByKey(DatabaseManager& dbManager, const string& userKey) {
     }
 }
 
+string getUserIdByKey(DatabaseManager& dbManager, const DatabaseSnapshot& snapshot, const string& userKey) {
+    try {
+        Vector<string> selectCol = {"user.user_id"};
+        Vector<Condition> cond;
+        cond.push_back(Condition{"user.key", escape(userKey), "="});
+
+        Vector<string> results;
+        selectSnapshotCapture(dbManager, snapshot, selectCol, "user", cond, results);
+        if (results.get_size() > 0) {
+            return results[0];
+        }
+        return "";
+    }
+    catch (const exception& e) {
+        return "";
+    }
+}
+
 string generateUserKey() {
     static const char alphanum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
     const int keyLength = 32;
@@ -69,110 +111,141 @@ string generateUserKey() {
     return key;
 }
 
-string handleGetLots(DatabaseManager& dbManager) {
+struct ResponseCache {
+    mutex mtx;
+    bool valid = false;
+    unsigned long version = 0;
+    shared_ptr<const string> bytes;
+};
+
+static ResponseCache lotsCache[2];
+static ResponseCache pairsCache[2];
+
+// Готовый HTTP-ответ живет, пока не изменится версия таблицы в опубликованном срезе.
+// Клиент с актуальной меткой (If-None-Match) получает 304 без тела.
+static shared_ptr<const string> cachedTableResponse(const DatabaseSnapshot& snapshot, const string& tableName, bool pretty, const string& ifNoneMatch, ResponseCache& cache, const function<string()>& build) {
+    unsigned long version = snapshotTableVersion(snapshot, tableName);
+    string etag = versionETag(tableName, version, pretty);
+    if (ifNoneMatch == etag) {
+        return make_shared<const string>(notModifiedResponse(etag));
+    }
+
+    lock_guard<mutex> lock(cache.mtx);
+    if (cache.valid && cache.version == version) {
+        return cache.bytes;
+    }
+
+    cache.bytes = make_shared<const string>(makeHttpResponse(200, build(), "ETag: " + etag + "\r\n"));
+    cache.version = version;
+    cache.valid = true;
+    return cache.bytes;
+}
+
+shared_ptr<const string> handleGetLots(DatabaseManager& dbManager, bool pretty, const string& ifNoneMatch) {
     try {
         cout << "[INFO] Запрос списка лотов" << endl;
-        Vector<string> selectCol = {"lot.lot_id", "lot.name"};
-        Vector<string> tables = {"lot"};
-        Vector<Condition> conditions;
+        shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
 
-        Vector<string> results;
-        selectDataCapture(dbManager, selectCol, tables, conditions, results);
-
-        json response = json::array();
+        return cachedTableResponse(*snapshot, "lot", pretty, ifNoneMatch, lotsCache[pretty], [&]() {
+            int idIdx = rowColumnIndex(dbManager, "lot", "lot_id");
+            int nameIdx = rowColumnIndex(dbManager, "lot", "name");
+            Vector<Condition> conditions;
 
-        for (size_t i = 0; i < results.get_size(); i++) {
-            stringstream ss(results[i]);
-            string lotId, name;
-            
-            getline(ss, lotId, ',');
-            getline(ss, name, ',');
+            string body;
+            JsonWriter writer(body, pretty);
+            writer.beginArray();
+            scanSnapshot(dbManager, *snapshot, "lot", conditions, [&](const Vector<string>& row) {
+                writer.beginObject();
+                writer.key("lot_id");
+                writer.value(stoi(row[idIdx]));
+                writer.key("name");
+                writer.value(row[nameIdx]);
+                writer.endObject();
+            });
+            writer.endArray();
 
-            json lot;
-            lot["lot_id"] = stoi(lotId);
-            lot["name"] = name;
-            response.push_back(lot);
-        }
-        return makeHttpResponse(200, response.dump(4));
+            return body;
+        });
     }
     catch (const exception& e) {
         json error;
         error["error"] = "Internal server error33";
         error["message"] = e.what();
-        return makeHttpResponse(500, error.dump(4));
+        return make_shared<const string>(makeHttpResponse(500, error.dump()));
     }
 }
 
-string handleGetPairs(DatabaseManager& dbManager) {
+shared_ptr<const string> handleGetPairs(DatabaseManager& dbManager, bool pretty, const string& ifNoneMatch) {
     try {
         cout << "[INFO] Запрос списка пар" << endl;
-        Vector<string> selectCol = {"pair.pair_id", "pair.first_lot_id", "pair.second_lot_id"};
-        Vector<string> tables = {"pair"};
-        Vector<Condition> cond;
-        
-        Vector<string> results;
-        selectDataCapture(dbManager, selectCol, tables, cond, results);
+        shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
 
-        json response = json::array();
+        return cachedTableResponse(*snapshot, "pair", pretty, ifNoneMatch, pairsCache[pretty], [&]() {
+            int idIdx = rowColumnIndex(dbManager, "pair", "pair_id");
+            int firstIdx = rowColumnIndex(dbManager, "pair", "first_lot_id");
+            int secondIdx = rowColumnIndex(dbManager, "pair", "second_lot_id");
+            Vector<Condition> cond;
 
-        for (size_t i = 0; i < results.get_size(); i++) {
-            stringstream ss(results[i]);
-            string pairId, firstLotId, secondLotId;
+            string body;
+            JsonWriter writer(body, pretty);
+            writer.beginArray();
+            scanSnapshot(dbManager, *snapshot, "pair", cond, [&](const Vector<string>& row) {
+                writer.beginObject();
+                writer.key("pair_id");
+                writer.value(stoi(row[idIdx]));
+                writer.key("sale_lot_id");
+                writer.value(stoi(row[firstIdx]));
+                writer.key("buy_lot_id");
+                writer.value(stoi(row[secondIdx]));
+                writer.endObject();
+            });
+            writer.endArray();
 
-            getline(ss, pairId, ',');
-            getline(ss, firstLotId, ',');
-            getline(ss, secondLotId, ',');
-
-            json pair;
-            pair["pair_id"] = stoi(pairId);
-            pair["sale_lot_id"] = stoi(firstLotId);
-            pair["buy_lot_id"] = stoi(secondLotId);
-            response.push_back(pair);
-        }
-
-        return makeHttpResponse(200, response.dump(4));
+            return body;
+        });
     }
     catch (const exception& e) {
         json error;
         error["error"] = "Internal server error44";
         error["message"] = e.what();
-        return makeHttpResponse(500, error.dump(4));
+        return make_shared<const string>(makeHttpResponse(500, error.dump()));
     }
 }
 
 string handleCreateUser(DatabaseManager& dbManager, const string& body) {
-    static mutex orderCreationMutex;
-    lock_guard<mutex> mainLock(orderCreationMutex);
     try {
         cout << "[INFO] Создание пользователя: " << body << endl;
         json request = parseJsonBody(body);
 
         if (!hasField(request, "username")) {
             json error = {{"error", "Не заполнено: username"}};
-            return makeHttpResponse(400, error.dump(4));
+            return makeHttpResponse(400, error.dump());
         }
 
         string username = request["username"].get<string>();
         if (username.empty()) {
             json error = {{"error", "Username не может быть пустым"}};
-            return makeHttpResponse(400, error.dump(4));
+            return makeHttpResponse(400, error.dump());
         }
 
-        string pkPath = dbManager.getSchemaName() + "/user/user_pk_sequence";
-        int userId = 1;
-        ifstream pkFile(pkPath);
-        if (pkFile.is_open()) {
-            pkFile >> userId;
-            pkFile.close();
-        }
-        
         string userKey = generateUserKey();
-        int oldUserId = userId;
+        int oldUserId;
+        {
+            TableLockGuard storageLock(dbManager, "user", LockMode::Exclusive, STORAGE_LOCK_TIMEOUT_MS);
+            string pkPath = dbManager.getSchemaName() + "/user/user_pk_sequence";
+            int userId = 1;
+            ifstream pkFile(pkPath);
+            if (pkFile.is_open()) {
+                pkFile >> userId;
+                pkFile.close();
+            }
+            oldUserId = userId;
 
-        string safeUsername = escape(username);
-        string safeKey = escape(userKey);
-        string query = "VALUES('" + safeUsername + "','" + safeKey + "')";
-        insertData(dbManager, "user", query, userId);
+            string safeUsername = escape(username);
+            string safeKey = escape(userKey);
+            string query = "VALUES('" + safeUsername + "','" + safeKey + "')";
+            insertData(dbManager, "user", query, userId);
+        }
 
         Vector<string> lotCol = {"lot.lot_id"};
         Vector<string> lotTables = {"lot"};
@@ -180,413 +253,733 @@ string handleCreateUser(DatabaseManager& dbManager, const string& body) {
         Vector<string> lotResult;
         selectDataCapture(dbManager, lotCol, lotTables, lotCond, lotResult);
 
-        for (size_t i = 0; i < lotResult.get_size(); i++) {
-            string lotId = lotResult[i];
-            string userLotPkPath = dbManager.getSchemaName() + "/user_lot/user_lot_pk_sequence";
-            int userLotPk = 1;
-            ifstream userLotPkFile(userLotPkPath);
-            if (userLotPkFile.is_open()) {
-                userLotPkFile >> userLotPk;
-                userLotPkFile.close();
-            }
-
-            string userLotQuery = "VALUES('" + to_string(oldUserId) + "','" + lotId + "','1000.000000')";
-            insertData(dbManager, "user_lot", userLotQuery, userLotPk);
-        }
+        openAccounts(to_string(oldUserId), lotResult, 1000);
 
         json response;
         response["key"] = userKey;
-        return makeHttpResponse(201, response.dump(4));
+        return makeHttpResponse(201, response.dump());
     }
     catch (const exception& e) {
         json error = {{"error", "Internal server error55"}, {"message", e.what()}};
-        return makeHttpResponse(500, error.dump(4));
+        return makeHttpResponse(500, error.dump());
     }
 }
 
-string handleGetBalance(DatabaseManager& dbManager, const string& userKey) {
+string handleGetBalance(DatabaseManager& dbManager, const string& userKey, bool pretty, const string& ifNoneMatch) {
     try {
         cout << "[INFO] Пользователь " << userKey << " запрашивает баланс" << endl;
         if (userKey.empty()) {
             json error = {{"error", "Нет заголовка X-USER-KEY"}};
-            return makeHttpResponse(401, error.dump(4));
+            return makeHttpResponse(401, error.dump());
         }
 
-        string userId = getUserIdByKey(dbManager, userKey);
+        shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
+
+        string userId = getUserIdByKey(dbManager, *snapshot, userKey);
         if (userId.empty()) {
             json error = {{"error", "Некорректный ключ пользователя"}};
-            return makeHttpResponse(403, error.dump(4));
+            return makeHttpResponse(403, error.dump());
         }
 
-        Vector<string> selectCol = {"user_lot.lot_id", "user_lot.quantity"};
-        Vector<string> tables = {"user_lot"};
-        Vector<Condition> cond;
-        cond.push_back(Condition{"user_lot.user_id", userId, "="});
+        // версия читается до остатков: метка может только отстать от данных, но не опередить их
+        string etag = versionETag("balance-" + userId, accountsVersion(userId), pretty);
+        if (ifNoneMatch == etag) {
+            return notModifiedResponse(etag);
+        }
 
-        Vector<string> results;
-        selectDataCapture(dbManager, selectCol, tables, cond, results);
+        Vector<AccountBalance> accounts = userAccounts(userId);
 
-        json response = json::array();
-        for (size_t i = 0; i < results.get_size(); i++) {
-            stringstream ss(results[i]);
-            string lotId, quantity;
-            getline(ss, lotId, ',');
-            getline(ss, quantity, ',');
-            json balance;
-            balance["lot_id"] = stoi(lotId);
-            balance["quantity"] = stod(quantity);
-            response.push_back(balance);
+        string body;
+        JsonWriter writer(body, pretty);
+        writer.beginArray();
+        for (size_t i = 0; i < accounts.get_size(); i++) {
+            if (accounts[i].available < EPSILON && accounts[i].locked < EPSILON) {
+                continue;
+            }
+            writer.beginObject();
+            writer.key("lot_id");
+            writer.value(stoi(accounts[i].lotId));
+            writer.key("quantity");
+            writer.value(stod(to_string(accounts[i].available)));
+            writer.key("locked");
+            writer.value(stod(to_string(accounts[i].locked)));
+            writer.endObject();
         }
-        return makeHttpResponse(200, response.dump(4));
+        writer.endArray();
+
+        return makeHttpResponse(200, body, "ETag: " + etag + "\r\n");
     }
     catch (const exception& e) {
         json error = {{"error", "Internal server error66"}, {"message", e.what()}};
-        return makeHttpResponse(500, error.dump(4));
+        return makeHttpResponse(500, error.dump());
+    }
+}
+
+static bool parseIdParam(const HashTable<string, string>& params, const string& name, long long& value) {
+    if (!params.contains(name)) {
+        return true;
+    }
+    const string& raw = params.at(name);
+    if (raw.empty() || raw.find_first_not_of("0123456789") != string::npos || raw.size() > 18) {
+        return false;
     }
+    value = stoll(raw);
+    return true;
 }
 
-string handleGetOrders(DatabaseManager& dbManager) {
+void handleGetOrders(DatabaseManager& dbManager, HttpStream& stream, const HashTable<string, string>& params, const string& ifNoneMatch) {
     try {
         cout << "[INFO] Запрос списка ордеров" << endl;
-        Vector<string> selectCol = {
-            "order.order_id", 
-            "order.user_id", 
-            "order.pair_id", 
-            "order.quantity", 
-            "order.price", 
-            "order.type", 
-            "order.closed"
+        bool pretty = queryFlag(params, "pretty");
+
+        long long pairFilter = -1, userFilter = -1, limit = 0, afterId = 0;
+        if (!parseIdParam(params, "pair_id", pairFilter) || !parseIdParam(params, "user", userFilter) ||
+            !parseIdParam(params, "limit", limit) || !parseIdParam(params, "after_id", afterId)) {
+            stream.fail(400, R"({"error": "Параметры pair_id, user, limit и after_id должны быть неотрицательными целыми"})");
+            return;
+        }
+
+        string status = params.contains("status") ? params.at("status") : "";
+        if (!status.empty() && status != "open" && status != "closed") {
+            stream.fail(400, R"({"error": "status принимает значения 'open' или 'closed'"})");
+            return;
+        }
+
+        string pairText = pairFilter >= 0 ? to_string(pairFilter) : "";
+        string userText = userFilter >= 0 ? to_string(userFilter) : "";
+
+        int orderIdIdx = rowColumnIndex(dbManager, "order", "order_id");
+        int userIdIdx = rowColumnIndex(dbManager, "order", "user_id");
+        int pairIdIdx = rowColumnIndex(dbManager, "order", "pair_id");
+        int quantityIdx = rowColumnIndex(dbManager, "order", "quantity");
+        int priceIdx = rowColumnIndex(dbManager, "order", "price");
+        int typeIdx = rowColumnIndex(dbManager, "order", "type");
+        int closedIdx = rowColumnIndex(dbManager, "order", "closed");
+        
+        shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
+        string etag = versionETag("order", snapshotTableVersion(*snapshot, "order"), pretty);
+        if (ifNoneMatch == etag) {
+            stream.notModified(etag);
+            return;
+        }
+        stream.addHeader("ETag", etag);
+
+        auto matches = [&](const Vector<string>& row) {
+            if (!pairText.empty() && row[pairIdIdx] != pairText) return false;
+            if (!userText.empty() && row[userIdIdx] != userText) return false;
+            if (status == "open" && !row[closedIdx].empty()) return false;
+            if (status == "closed" && row[closedIdx].empty()) return false;
+            return true;
         };
-        Vector<string> tables = {"order"};
-        Vector<Condition> cond;
-        
-        Vector<string> results;
-        selectDataCapture(dbManager, selectCol, tables, cond, results);
-        json response = json::array();
-        
-        for (size_t i = 0; i < results.get_size(); i++) {
-            stringstream ss(results[i]);
-            string orderId, userId, pairId, quantity, price, type, closed;
-            
-            getline(ss, orderId, ',');
-            getline(ss, userId, ',');
-            getline(ss, pairId, ',');
-            getline(ss, quantity, ',');
-            getline(ss, price, ',');
-            getline(ss, type, ',');
-            getline(ss, closed, ',');
-            
-            json order;
-            order["order_id"] = stoi(orderId);
-            order["user_id"] = stoi(userId);
-            order["pair_id"] = stoi(pairId);
-            order["quantity"] = stod(quantity);
-            order["price"] = stod(price);
-            order["type"] = type;
-            order["closed"] = closed;
-            response.push_back(order);
+
+        // закрытые заявки старше ORDER_ARCHIVE_AGE_SEC лежат в архиве: по status=closed они вливаются
+        // в обход горячей таблицы по order_id. Архив читается после захвата среза, поэтому строка,
+        // перенесенная между ними, окажется в обоих местах и будет отдана один раз
+        Vector<Vector<string>> archived;
+        if (status == "closed") {
+            archived = readArchivedOrders(dbManager, afterId, limit, matches);
+        }
+        size_t nextArchived = 0;
+
+        long long written = 0;
+        JsonWriter writer(stream.body(), pretty);
+        auto writeOrder = [&](const Vector<string>& row) {
+            writer.beginObject();
+            writer.key("order_id");
+            writer.value(stoi(row[orderIdIdx]));
+            writer.key("user_id");
+            writer.value(stoi(row[userIdIdx]));
+            writer.key("pair_id");
+            writer.value(stoi(row[pairIdIdx]));
+            writer.key("quantity");
+            writer.value(stod(row[quantityIdx]));
+            writer.key("price");
+            writer.value(stod(row[priceIdx]));
+            writer.key("type");
+            writer.value(row[typeIdx]);
+            writer.key("closed");
+            writer.value(row[closedIdx]);
+            writer.endObject();
+            stream.flushIfNeeded();
+            written++;
+        };
+
+        writer.beginArray();
+        scanSnapshotRange(dbManager, *snapshot, "order", afterId, [&](const Vector<string>& row) {
+            long long orderId = stoll(row[orderIdIdx]);
+            while (nextArchived < archived.get_size() && stoll(archived[nextArchived][orderIdIdx]) < orderId && (limit == 0 || written < limit)) {
+                writeOrder(archived[nextArchived++]);
+            }
+            if (nextArchived < archived.get_size() && stoll(archived[nextArchived][orderIdIdx]) == orderId) {
+                nextArchived++;
+            }
+            if (limit > 0 && written >= limit) return false;
+            if (!matches(row)) return true;
+
+            writeOrder(row);
+            return limit == 0 || written < limit;
+        });
+        while (nextArchived < archived.get_size() && (limit == 0 || written < limit)) {
+            writeOrder(archived[nextArchived++]);
         }
+        writer.endArray();
         
-        return makeHttpResponse(200, response.dump(4));
+        stream.finish();
         
     } catch (const exception& e) {
         json error = {{"error", "Internal server error77"}, {"message", e.what()}};
-        return makeHttpResponse(500, error.dump(4));
+        stream.fail(500, error.dump());
     }
 }
 
-PairInfo getPairInfo(DatabaseManager& dbManager, const string& pairId) {
-    PairInfo info;
-    Vector<string> selectCol = {"pair.first_lot_id", "pair.second_lot_id"};
-    Vector<string> tables = {"pair"};
+void handleGetTrades(DatabaseManager& dbManager, HttpStream& stream, const HashTable<string, string>& params, const string& ifNoneMatch) {
+    try {
+        cout << "[INFO] Запрос списка сделок" << endl;
+        bool pretty = queryFlag(params, "pretty");
+
+        long long pairFilter = -1, orderFilter = -1, limit = 0, afterId = 0;
+        if (!parseIdParam(params, "pair_id", pairFilter) || !parseIdParam(params, "order_id", orderFilter) ||
+            !parseIdParam(params, "limit", limit) || !parseIdParam(params, "after_id", afterId)) {
+            stream.fail(400, R"({"error": "Параметры pair_id, order_id, limit и after_id должны быть неотрицательными целыми"})");
+            return;
+        }
+
+        string pairText = pairFilter >= 0 ? to_string(pairFilter) : "";
+        string orderText = orderFilter >= 0 ? to_string(orderFilter) : "";
+
+        int tradeIdIdx = rowColumnIndex(dbManager, "trade", "trade_id");
+        int pairIdIdx = rowColumnIndex(dbManager, "trade", "pair_id");
+        int buyOrderIdx = rowColumnIndex(dbManager, "trade", "buy_order_id");
+        int sellOrderIdx = rowColumnIndex(dbManager, "trade", "sell_order_id");
+        int priceIdx = rowColumnIndex(dbManager, "trade", "price");
+        int quantityIdx = rowColumnIndex(dbManager, "trade", "quantity");
+        int timestampIdx = rowColumnIndex(dbManager, "trade", "timestamp");
+
+        shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
+        string etag = versionETag("trade", snapshotTableVersion(*snapshot, "trade"), pretty);
+        if (ifNoneMatch == etag) {
+            stream.notModified(etag);
+            return;
+        }
+        stream.addHeader("ETag", etag);
+
+        long long written = 0;
+        JsonWriter writer(stream.body(), pretty);
+        writer.beginArray();
+        scanSnapshotRange(dbManager, *snapshot, "trade", afterId, [&](const Vector<string>& row) {
+            if (!pairText.empty() && row[pairIdIdx] != pairText) return true;
+            if (!orderText.empty() && row[buyOrderIdx] != orderText && row[sellOrderIdx] != orderText) return true;
+
+            writer.beginObject();
+            writer.key("trade_id");
+            writer.value(stoi(row[tradeIdIdx]));
+            writer.key("pair_id");
+            writer.value(stoi(row[pairIdIdx]));
+            writer.key("buy_order_id");
+            writer.value(stoi(row[buyOrderIdx]));
+            writer.key("sell_order_id");
+            writer.value(stoi(row[sellOrderIdx]));
+            writer.key("price");
+            writer.value(stod(row[priceIdx]));
+            writer.key("quantity");
+            writer.value(stod(row[quantityIdx]));
+            writer.key("timestamp");
+            writer.value(row[timestampIdx]);
+            writer.endObject();
+            stream.flushIfNeeded();
+
+            written++;
+            return limit == 0 || written < limit;
+        });
+        writer.endArray();
+
+        stream.finish();
+
+    } catch (const exception& e) {
+        json error = {{"error", "Internal server error102"}, {"message", e.what()}};
+        stream.fail(500, error.dump());
+    }
+}
+
+static void writeLevels(JsonWriter& writer, const Vector<PriceLevel>& levels) {
+    writer.beginArray();
+    for (size_t i = 0; i < levels.get_size(); i++) {
+        writer.beginObject();
+        writer.key("price");
+        writer.value(levels[i].price);
+        writer.key("quantity");
+        writer.value(levels[i].quantity);
+        writer.key("orders");
+        writer.value(levels[i].orders);
+        writer.endObject();
+    }
+    writer.endArray();
+}
+
+static void writeBook(JsonWriter& writer, const string& pairId, size_t depth) {
+    Vector<PriceLevel> bids, asks;
+    int bidOrders = 0, askOrders = 0;
+    unsigned long long seq = 0;
+    bookSnapshot(pairId, depth, bids, asks, bidOrders, askOrders, seq);
+
+    writer.beginObject();
+    writer.key("pair_id");
+    writer.value(stoi(pairId));
+    writer.key("seq");
+    writer.value((long long)seq);
+    writer.key("bid_orders");
+    writer.value(bidOrders);
+    writer.key("ask_orders");
+    writer.value(askOrders);
+    writer.key("bids");
+    writeLevels(writer, bids);
+    writer.key("asks");
+    writeLevels(writer, asks);
+    writer.endObject();
+}
+
+static bool pairExists(DatabaseManager& dbManager, const string& pairId) {
+    shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
+    Vector<string> pairIds;
     Vector<Condition> cond;
     cond.push_back(Condition{"pair.pair_id", pairId, "="});
-    
-    Vector<string> results;
-    selectDataCapture(dbManager, selectCol, tables, cond, results);
-    
-    if (!results.empty()) {
-        stringstream ss(results[0]);
-        getline(ss, info.firstLotId, ',');
-        getline(ss, info.secondLotId, ',');
-        info.pairId = pairId;
+    selectSnapshotCapture(dbManager, *snapshot, {"pair.pair_id"}, "pair", cond, pairIds);
+    return !pairIds.empty();
+}
+
+string handleGetOrderBook(DatabaseManager& dbManager, const HashTable<string, string>& params, const string& ifNoneMatch) {
+    try {
+        bool pretty = queryFlag(params, "pretty");
+
+        long long pairFilter = -1, depth = 10;
+        if (!parseIdParam(params, "pair_id", pairFilter) || !parseIdParam(params, "depth", depth) || depth == 0) {
+            return makeHttpResponse(400, R"({"error": "pair_id и depth должны быть положительными целыми"})");
+        }
+
+        // стаканы меняются только вместе с номером ленты, он и служит версией
+        string etag = versionETag("book", marketFeedSequence(), pretty);
+        if (ifNoneMatch == etag) {
+            return notModifiedResponse(etag);
+        }
+
+        string body;
+        JsonWriter writer(body, pretty);
+
+        if (pairFilter >= 0) {
+            string pairId = to_string(pairFilter);
+            if (!pairExists(dbManager, pairId)) {
+                return makeHttpResponse(404, R"({"error": "Пара не найдена"})");
+            }
+
+            writeBook(writer, pairId, depth);
+        }
+        else {
+            Vector<string> pairIds = bookPairIds();
+            writer.beginArray();
+            for (size_t i = 0; i < pairIds.get_size(); i++) {
+                writeBook(writer, pairIds[i], depth);
+            }
+            writer.endArray();
+        }
+
+        return makeHttpResponse(200, body, "ETag: " + etag + "\r\n");
+    }
+    catch (const exception& e) {
+        json error = {{"error", "Internal server error88"}, {"message", e.what()}};
+        return makeHttpResponse(500, error.dump());
     }
-    return info;
 }
 
-double getUserBalance(DatabaseManager& dbManager, const string& userId, const string& lotId) {
-    Vector<string> selectCol = {"user_lot.quantity"};
-    Vector<string> tables = {"user_lot"};
-    Vector<Condition> cond;
-    cond.push_back(Condition{"user_lot.user_id", userId, "="});
-    cond.push_back(Condition{"user_lot.lot_id", lotId, "="});
-    
-    Vector<string> results;
-    selectDataCapture(dbManager, selectCol, tables, cond, results);
-    
-    if (!results.empty()) {
-        return stod(results[0]);
+static void writeMarketEvent(JsonWriter& writer, const MarketEvent& event) {
+    writer.beginObject();
+    writer.key("seq");
+    writer.value((long long)event.seq);
+    writer.key("pair_id");
+    writer.value(stoi(event.pairId));
+    writer.key("type");
+    writer.value(event.type);
+    writer.key("order_id");
+    writer.value(event.orderId);
+    writer.key("side");
+    writer.value(event.side);
+    writer.key("price");
+    writer.value(event.price);
+    writer.key("quantity");
+    writer.value(event.quantity);
+    writer.key("remaining");
+    writer.value(event.remaining);
+    writer.endObject();
+}
+
+// Общий разбор параметров ленты: pair_id, since, timeout (мс), limit.
+// Заголовок Last-Event-ID (переподключение EventSource) заменяет отсутствующий since.
+static bool parseFeedParams(DatabaseManager& dbManager, const HashTable<string, string>& params, const string& lastEventId, string& pairId, unsigned long long& since, long long& timeoutMs, long long& limit, string& error) {
+    long long pairFilter = -1, sinceParam = -1;
+    if (!parseIdParam(params, "pair_id", pairFilter) || !parseIdParam(params, "since", sinceParam) ||
+        !parseIdParam(params, "timeout", timeoutMs) || !parseIdParam(params, "limit", limit) || limit == 0) {
+        error = makeHttpResponse(400, R"({"error": "Параметры pair_id, since, timeout и limit должны быть неотрицательными целыми"})");
+        return false;
+    }
+
+    if (pairFilter >= 0) {
+        pairId = to_string(pairFilter);
+        if (!pairExists(dbManager, pairId)) {
+            error = makeHttpResponse(404, R"({"error": "Пара не найдена"})");
+            return false;
+        }
+    }
+
+    if (sinceParam < 0 && !lastEventId.empty() && lastEventId.size() <= 18 && lastEventId.find_first_not_of("0123456789") == string::npos) {
+        sinceParam = stoll(lastEventId);
+    }
+
+    // без since клиент получает только события, появившиеся после запроса
+    since = sinceParam >= 0 ? sinceParam : marketFeedSequence();
+    timeoutMs = min(timeoutMs, MAX_FEED_TIMEOUT_MS);
+    limit = min(limit, (long long)MARKET_FEED_CAPACITY);
+    return true;
+}
+
+string handleGetMarketFeed(DatabaseManager& dbManager, const HashTable<string, string>& params) {
+    try {
+        bool pretty = queryFlag(params, "pretty");
+
+        string pairId, error;
+        unsigned long long since = 0;
+        long long timeoutMs = 0, limit = 1000;
+        if (!parseFeedParams(dbManager, params, "", pairId, since, timeoutMs, limit, error)) {
+            return error;
+        }
+
+        Vector<MarketEvent> events;
+        unsigned long long lastSeq = 0;
+        bool continuous = readMarketEvents(pairId, since, limit, timeoutMs, events, lastSeq);
+
+        string body;
+        JsonWriter writer(body, pretty);
+        writer.beginObject();
+        writer.key("seq");
+        writer.value((long long)lastSeq);
+        writer.key("reset");
+        writer.value(!continuous);
+        writer.key("events");
+        writer.beginArray();
+        for (size_t i = 0; i < events.get_size(); i++) {
+            writeMarketEvent(writer, events[i]);
+        }
+        writer.endArray();
+        writer.endObject();
+
+        return makeHttpResponse(200, body);
+    }
+    catch (const exception& e) {
+        json error = {{"error", "Internal server error99"}, {"message", e.what()}};
+        return makeHttpResponse(500, error.dump());
     }
-    return 0.0;
 }
 
-void updateUserBalance(DatabaseManager& dbManager, const string& userId, const string& lotId, double delta) {
+void handleMarketStream(DatabaseManager& dbManager, int clientSocket, const HashTable<string, string>& params, const string& lastEventId) {
     try {
-        if (abs(delta) < EPSILON) {
+        string pairId, error;
+        unsigned long long since = 0;
+        long long timeoutMs = 0, limit = 256;
+        if (!parseFeedParams(dbManager, params, lastEventId, pairId, since, timeoutMs, limit, error)) {
+            sendAll(clientSocket, error.data(), error.size());
             return;
         }
 
-        const string schema = dbManager.getSchemaName();
-        string tableName = "user_lot";
-        
-        int fileIndex = 1;
-        bool found = false;
-        bool recordUpdated = false;
-        
+        string headers = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n\r\n";
+        if (!sendAll(clientSocket, headers.data(), headers.size())) {
+            return;
+        }
+
+        cout << "[INFO] Подписка на ленту стакана, since=" << since << endl;
+        string frame;
         while (true) {
-            string csvPath = schema + "/" + tableName + "/" + to_string(fileIndex) + ".csv";
-            ifstream in(csvPath);
-            
-            if (!in.is_open()) {
-                break;
-            }
-            
-            string tmpPath = csvPath + ".tmp";
-            ofstream out(tmpPath);
-            
-            if (!out.is_open()) {
-                in.close();
-                return;
-            }
-            
-            string header;
-            getline(in, header);
-            out << header << "\n";
-            
-            Vector<string> headerCols = splitCSV(header);
-            size_t colCount = headerCols.get_size();
-            
-            int userIdIdx = -1, lotIdIdx = -1, quantityIdx = -1;
-            for (size_t i = 0; i < colCount; i++) {
-                if (headerCols[i] == "user_id") userIdIdx = i;
-                if (headerCols[i] == "lot_id") lotIdIdx = i;
-                if (headerCols[i] == "quantity") quantityIdx = i;
+            Vector<MarketEvent> events;
+            unsigned long long lastSeq = 0;
+            bool continuous = readMarketEvents(pairId, since, limit, FEED_HEARTBEAT_MS, events, lastSeq);
+
+            frame.clear();
+            if (!continuous) {
+                // клиент отстал: ему нужно заново загрузить /orderbook и продолжить с lastSeq
+                frame = "id: " + to_string(lastSeq) + "\nevent: reset\ndata: {\"seq\":" + to_string(lastSeq) + "}\n\n";
             }
-            
-            if (userIdIdx == -1 || lotIdIdx == -1 || quantityIdx == -1) {
-                in.close();
-                out.close();
-                remove(tmpPath.c_str());
-                return;
+            for (size_t i = 0; i < events.get_size(); i++) {
+                frame += "id: " + to_string(events[i].seq) + "\nevent: " + events[i].type + "\ndata: ";
+                JsonWriter writer(frame);
+                writeMarketEvent(writer, events[i]);
+                frame += "\n\n";
             }
-            
-            string line;
-            
-            while (getline(in, line)) {
-                if (line.empty()) continue;
-                
-                Vector<string> values = splitCSV(line);
-                if (values.get_size() >= colCount) {
-                    string currentUserId = values[userIdIdx];
-                    string currentLotId = values[lotIdIdx];
-                    
-                    if (currentUserId == userId && currentLotId == lotId) {
-                        found = true;
-                        double currentBalance = stod(values[quantityIdx]);
-                        double newBalance = currentBalance + delta;
-                        
-                        if (newBalance < -EPSILON) {
-                            in.close();
-                            out.close();
-                            remove(tmpPath.c_str());
-                            throw runtime_error("Отрицательный баланс у пользователя");
-                        }
-                        
-                        if (newBalance < EPSILON) {
-                            recordUpdated = true;
-                            continue;
-                        }
-                        
-                        values[quantityIdx] = to_string(newBalance);
-                        
-                        string newLine;
-                        for (size_t i = 0; i < values.get_size(); i++) {
-                            if (i > 0) newLine += ",";
-                            newLine += values[i];
-                        }
-                        
-                        out << newLine << "\n";
-                        recordUpdated = true;
-                        continue;
-                    }
-                }
-                
-                out << line << "\n";
+            if (frame.empty()) {
+                // комментарий-пульс: так обнаруживается отключившийся клиент
+                frame = ": ping\n\n";
             }
-            
-            in.close();
-            out.close();
-            
-            if (recordUpdated) {
-                remove(csvPath.c_str());
-                rename(tmpPath.c_str(), csvPath.c_str());
-                return;
-            } else {
-                remove(tmpPath.c_str());
+
+            if (!sendAll(clientSocket, frame.data(), frame.size())) {
+                break;
             }
-            
-            fileIndex++;
+            since = lastSeq;
         }
-        
-        if (!found && delta > EPSILON) {
-            fileIndex = 1;
-            string lastFilePath;
-            
-            while (true) {
-                string csvPath = schema + "/" + tableName + "/" + to_string(fileIndex) + ".csv";
-                ifstream test(csvPath);
-                if (!test.is_open()) {
-                    break;
-                }
-                test.close();
-                lastFilePath = csvPath;
-                fileIndex++;
-            }
-            
-            if (lastFilePath.empty()) {
-                lastFilePath = schema + "/" + tableName + "/1.csv";
-            }
-            
-            ofstream out(lastFilePath, ios::app);
-            if (out.is_open()) {
-                string pkPath = schema + "/" + tableName + "/" + tableName + "_pk_sequence";
-                int newPk = 1;
-                ifstream pkFile(pkPath);
-                if (pkFile.is_open()) {
-                    pkFile >> newPk;
-                    pkFile.close();
+    }
+    catch (const exception& e) {
+        cerr << "[ERROR] Лента стакана: " << e.what() << endl;
+    }
+}
+
+// Заявки пользователя из индекса по user_id: стоимость зависит только от числа его собственных заявок
+string handleGetMyOrders(DatabaseManager& dbManager, const string& userKey, const HashTable<string, string>& params) {
+    try {
+        if (userKey.empty()) {
+            return makeHttpResponse(401, R"({"error": "Нет заголовка X-USER-KEY"})");
+        }
+
+        string userId = getUserIdByKey(dbManager, *acquireSnapshot(), userKey);
+        if (userId.empty()) {
+            return makeHttpResponse(403, R"({"error": "Неверный ключ пользователя"})");
+        }
+
+        bool pretty = queryFlag(params, "pretty");
+        long long pairFilter = -1;
+        if (!parseIdParam(params, "pair_id", pairFilter)) {
+            return makeHttpResponse(400, R"({"error": "Параметр pair_id должен быть неотрицательным целым"})");
+        }
+
+        string status = params.contains("status") ? params.at("status") : "";
+        if (!status.empty() && status != "open" && status != "closed") {
+            return makeHttpResponse(400, R"({"error": "status принимает значения 'open' или 'closed'"})");
+        }
+
+        string pairText = pairFilter >= 0 ? to_string(pairFilter) : "";
+        Vector<IndexedOrder> orders = indexUserOrders(userId, pairText, status);
+
+        // индекс повторяет только горячую таблицу, перенесенные в архив заявки вливаются по order_id
+        if (status == "closed") {
+            int orderIdIdx = rowColumnIndex(dbManager, "order", "order_id");
+            int userIdIdx = rowColumnIndex(dbManager, "order", "user_id");
+            int pairIdIdx = rowColumnIndex(dbManager, "order", "pair_id");
+            int quantityIdx = rowColumnIndex(dbManager, "order", "quantity");
+            int priceIdx = rowColumnIndex(dbManager, "order", "price");
+            int typeIdx = rowColumnIndex(dbManager, "order", "type");
+            int closedIdx = rowColumnIndex(dbManager, "order", "closed");
+
+            Vector<Vector<string>> archived = readArchivedOrders(dbManager, 0, 0, [&](const Vector<string>& row) {
+                return row[userIdIdx] == userId && (pairText.empty() || row[pairIdIdx] == pairText) && !row[closedIdx].empty();
+            });
+
+            Vector<IndexedOrder> merged;
+            size_t hot = 0;
+            for (size_t i = 0; i < archived.get_size(); i++) {
+                long long orderId = stoll(archived[i][orderIdIdx]);
+                while (hot < orders.get_size() && orders[hot].orderId < orderId) {
+                    merged.push_back(orders[hot++]);
                 }
-                
-                out << newPk << "," << userId << "," << lotId << "," << to_string(delta) << "\n";
-                out.close();
-                
-                ofstream pkOut(pkPath);
-                if (pkOut.is_open()) {
-                    pkOut << (newPk + 1);
-                    pkOut.close();
+                if (hot < orders.get_size() && orders[hot].orderId == orderId) {
+                    continue;
                 }
+                const Vector<string>& row = archived[i];
+                merged.push_back(IndexedOrder{orderId, row[userIdIdx], row[pairIdIdx], row[quantityIdx], row[priceIdx], row[typeIdx], row[closedIdx]});
+            }
+            while (hot < orders.get_size()) {
+                merged.push_back(orders[hot++]);
             }
-        } else if (!found && delta < 0) {
-            throw runtime_error("Ошибка поиска баланса");
+            swap(orders, merged);
         }
-            
-    } catch (const exception& e) {
-        throw;
+
+        string body;
+        JsonWriter writer(body, pretty);
+        writer.beginArray();
+        for (size_t i = 0; i < orders.get_size(); i++) {
+            const IndexedOrder& order = orders[i];
+            writer.beginObject();
+            writer.key("order_id");
+            writer.value(order.orderId);
+            writer.key("user_id");
+            writer.value(stoi(order.userId));
+            writer.key("pair_id");
+            writer.value(stoi(order.pairId));
+            writer.key("quantity");
+            writer.value(stod(order.quantity));
+            writer.key("price");
+            writer.value(stod(order.price));
+            writer.key("type");
+            writer.value(order.type);
+            writer.key("closed");
+            writer.value(order.closed);
+            writer.endObject();
+        }
+        writer.endArray();
+
+        return makeHttpResponse(200, body);
+    }
+    catch (const exception& e) {
+        json error = {{"error", "Internal server error107"}, {"message", e.what()}};
+        return makeHttpResponse(500, error.dump());
     }
 }
 
-string getCurrentTimestamp() {
-    auto now = chrono::system_clock::now();
-    auto now_time_t = chrono::system_clock::to_time_t(now);
-    stringstream ss;
-    ss << now_time_t;
-    return ss.str();
-}
-
-bool updateOrderQuantity(DatabaseManager& dbManager, const string& orderId, double newQuantity) {
-    const string schema = dbManager.getSchemaName();
-    string tableName = "order";
-    
-    int fileIndex = 1;
-    
-    while (true) {
-        string csvPath = schema + "/" + tableName + "/" + to_string(fileIndex) + ".csv";
-        ifstream in(csvPath);
-        
-        if (!in.is_open()) {
-            break;
+string handleGetExecutions(DatabaseManager& dbManager, const string& userKey, const HashTable<string, string>& params) {
+    try {
+        if (userKey.empty()) {
+            return makeHttpResponse(401, R"({"error": "Нет заголовка X-USER-KEY"})");
         }
-        
-        string tmpPath = csvPath + ".tmp";
-        ofstream out(tmpPath);
-        
-        if (!out.is_open()) {
-            in.close();
-            return false;
+
+        shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
+        string userId = getUserIdByKey(dbManager, *snapshot, userKey);
+        if (userId.empty()) {
+            return makeHttpResponse(403, R"({"error": "Неверный ключ пользователя"})");
         }
-        
-        string header;
-        getline(in, header);
-        out << header << "\n";
-        
-        Vector<string> headerCols = splitCSV(header);
-        size_t colCount = headerCols.get_size();
-        
-        int orderIdIdx = -1, quantityIdx = -1;
-        for (size_t i = 0; i < colCount; i++) {
-            if (headerCols[i] == "order_id") orderIdIdx = i;
-            if (headerCols[i] == "quantity") quantityIdx = i;
+
+        bool pretty = queryFlag(params, "pretty");
+        long long sinceParam = -1, timeoutMs = 0, limit = 1000;
+        if (!parseIdParam(params, "since", sinceParam) || !parseIdParam(params, "timeout", timeoutMs) ||
+            !parseIdParam(params, "limit", limit) || limit == 0) {
+            return makeHttpResponse(400, R"({"error": "Параметры since, timeout и limit должны быть неотрицательными целыми"})");
         }
-        
-        if (orderIdIdx == -1 || quantityIdx == -1) {
-            in.close();
-            out.close();
-            remove(tmpPath.c_str());
-            return false;
+
+        unsigned long long since = sinceParam >= 0 ? sinceParam : executionSequence(userId);
+        timeoutMs = min(timeoutMs, MAX_FEED_TIMEOUT_MS);
+        limit = min(limit, (long long)EXECUTION_REPORTS_PER_USER);
+
+        Vector<ExecutionReport> reports;
+        unsigned long long lastSeq = 0;
+        bool continuous = readExecutions(userId, since, limit, timeoutMs, reports, lastSeq);
+
+        string body;
+        JsonWriter writer(body, pretty);
+        writer.beginObject();
+        writer.key("seq");
+        writer.value((long long)lastSeq);
+        writer.key("reset");
+        writer.value(!continuous);
+        writer.key("reports");
+        writer.beginArray();
+        for (size_t i = 0; i < reports.get_size(); i++) {
+            const ExecutionReport& report = reports[i];
+            writer.beginObject();
+            writer.key("seq");
+            writer.value((long long)report.seq);
+            writer.key("order_id");
+            writer.value(report.orderId);
+            writer.key("pair_id");
+            writer.value(stoi(report.pairId));
+            writer.key("side");
+            writer.value(report.side);
+            writer.key("status");
+            writer.value(report.status);
+            writer.key("price");
+            writer.value(report.price);
+            writer.key("last_quantity");
+            writer.value(report.lastQuantity);
+            writer.key("last_price");
+            writer.value(report.lastPrice);
+            writer.key("remaining");
+            writer.value(report.remaining);
+            writer.endObject();
         }
-        
-        string line;
-        bool updated = false;
-        
-        while (getline(in, line)) {
-            if (line.empty()) continue;
-            
-            Vector<string> values = splitCSV(line);
-            if (values.get_size() >= colCount) {
-                string currentOrderId = values[orderIdIdx];
-                
-                if (currentOrderId == orderId) {
-                    updated = true;
-                    values[quantityIdx] = to_string(newQuantity);
-                    
-                    string newLine;
-                    for (size_t i = 0; i < values.get_size(); i++) {
-                        if (i > 0) newLine += ",";
-                        newLine += values[i];
-                    }
-                    
-                    out << newLine << "\n";
-                    continue;
-                }
+        writer.endArray();
+        writer.endObject();
+
+        return makeHttpResponse(200, body);
+    }
+    catch (const exception& e) {
+        json error = {{"error", "Internal server error100"}, {"message", e.what()}};
+        return makeHttpResponse(500, error.dump());
+    }
+}
+
+string handleGetEngineStats(DatabaseManager& dbManager, bool pretty) {
+    try {
+        Vector<ShardStats> stats = engineStats();
+
+        Vector<Vector<int>> shardPairs(stats.get_size());
+        int pairIdIdx = rowColumnIndex(dbManager, "pair", "pair_id");
+        Vector<Condition> cond;
+        scanSnapshot(dbManager, *acquireSnapshot(), "pair", cond, [&](const Vector<string>& row) {
+            size_t shard = shardForPair(row[pairIdIdx]);
+            if (shard < shardPairs.get_size()) {
+                shardPairs[shard].push_back(stoi(row[pairIdIdx]));
             }
-            
-            out << line << "\n";
-        }
-        
-        in.close();
-        out.close();
-        
-        if (updated) {
-            remove(csvPath.c_str());
-            rename(tmpPath.c_str(), csvPath.c_str());
-            return true;
+        });
+
+        string body;
+        JsonWriter writer(body, pretty);
+        writer.beginArray();
+        for (size_t i = 0; i < stats.get_size(); i++) {
+            const ShardStats& shard = stats[i];
+            double busySeconds = shard.busyMicros / 1e6;
+
+            writer.beginObject();
+            writer.key("shard");
+            writer.value((long long)shard.shard);
+            writer.key("pairs");
+            writer.beginArray();
+            for (size_t j = 0; j < shardPairs[i].get_size(); j++) {
+                writer.value(shardPairs[i][j]);
+            }
+            writer.endArray();
+            writer.key("commands");
+            writer.value((long long)shard.commands);
+            writer.key("batches");
+            writer.value((long long)shard.batches);
+            writer.key("busy_ms");
+            writer.value((long long)(shard.busyMicros / 1000));
+            writer.key("commands_per_sec");
+            writer.value(busySeconds > 0 ? shard.commands / busySeconds : 0.0);
+            writer.endObject();
         }
-        
-        remove(tmpPath.c_str());
-        fileIndex++;
+        writer.endArray();
+
+        return makeHttpResponse(200, body);
+    }
+    catch (const exception& e) {
+        json error = {{"error", "Internal server error101"}, {"message", e.what()}};
+        return makeHttpResponse(500, error.dump());
     }
+}
+
+PairInfo getPairInfo(DatabaseManager& dbManager, const string& pairId) {
+    PairInfo info;
+    Vector<string> selectCol = {"pair.first_lot_id", "pair.second_lot_id"};
+    Vector<string> tables = {"pair"};
+    Vector<Condition> cond;
+    cond.push_back(Condition{"pair.pair_id", pairId, "="});
+    
+    Vector<string> results;
+    selectDataCapture(dbManager, selectCol, tables, cond, results);
     
-    return false;
+    if (!results.empty()) {
+        stringstream ss(results[0]);
+        getline(ss, info.firstLotId, ',');
+        getline(ss, info.secondLotId, ',');
+        info.pairId = pairId;
+    }
+    return info;
 }
 
-bool closeOrderWithTimestamp(DatabaseManager& dbManager, const string& orderId, const string& timestamp) {
+string getCurrentTimestamp() {
+    auto now = chrono::system_clock::now();
+    auto now_time_t = chrono::system_clock::to_time_t(now);
+    stringstream ss;
+    ss << now_time_t;
+    return ss.str();
+}
+
+// Переписывает у строк ордеров orderIds значения columns на newValues за один проход по чанкам;
+// проход заканчивается, как только найдены все строки. Возвращает число измененных строк
+int updateOrderRows(DatabaseManager& dbManager, const Vector<string>& orderIds, const Vector<string>& columns, const Vector<string>& newValues) {
+    TableLockGuard storageLock(dbManager, "order", LockMode::Exclusive, STORAGE_LOCK_TIMEOUT_MS);
+    HashTable<string, bool> pending;
+    for (size_t i = 0; i < orderIds.get_size(); i++) {
+        pending.insert(orderIds[i], true);
+    }
+    int updatedTotal = 0;
     const string schema = dbManager.getSchemaName();
     string tableName = "order";
     
     int fileIndex = 1;
-    string closeTime = timestamp.empty() ? getCurrentTimestamp() : timestamp;
     
-    while (true) {
+    while (updatedTotal < (int)orderIds.get_size()) {
         string csvPath = schema + "/" + tableName + "/" + to_string(fileIndex) + ".csv";
         ifstream in(csvPath);
         
@@ -599,7 +992,7 @@ bool closeOrderWithTimestamp(DatabaseManager& dbManager, const string& orderId,
         
         if (!out.is_open()) {
             in.close();
-            return false;
+            return updatedTotal;
         }
         
         string header;
@@ -609,21 +1002,28 @@ bool closeOrderWithTimestamp(DatabaseManager& dbManager, const string& orderId,
         Vector<string> headerCols = splitCSV(header);
         size_t colCount = headerCols.get_size();
         
-        int orderIdIdx = -1, closedIdx = -1;
+        int orderIdIdx = -1;
+        Vector<int> columnIdx(columns.get_size(), -1);
         for (size_t i = 0; i < colCount; i++) {
             if (headerCols[i] == "order_id") orderIdIdx = i;
-            if (headerCols[i] == "closed") closedIdx = i;
+            for (size_t j = 0; j < columns.get_size(); j++) {
+                if (headerCols[i] == columns[j]) columnIdx[j] = i;
+            }
         }
         
-        if (orderIdIdx == -1 || closedIdx == -1) {
+        bool missingColumn = orderIdIdx == -1;
+        for (size_t j = 0; j < columnIdx.get_size(); j++) {
+            if (columnIdx[j] == -1) missingColumn = true;
+        }
+        if (missingColumn) {
             in.close();
             out.close();
             remove(tmpPath.c_str());
-            return false;
+            return updatedTotal;
         }
         
         string line;
-        bool foundAndUpdated = false;
+        bool updated = false;
         
         while (getline(in, line)) {
             if (line.empty()) continue;
@@ -632,9 +1032,14 @@ bool closeOrderWithTimestamp(DatabaseManager& dbManager, const string& orderId,
             if (values.get_size() >= colCount) {
                 string currentOrderId = values[orderIdIdx];
                 
-                if (currentOrderId == orderId) {
-                    foundAndUpdated = true;
-                    values[closedIdx] = closeTime;
+                if (pending.contains(currentOrderId)) {
+                    pending.erase(currentOrderId);
+                    updated = true;
+                    updatedTotal++;
+                    for (size_t j = 0; j < columnIdx.get_size(); j++) {
+                        values[columnIdx[j]] = newValues[j];
+                    }
+                    indexUpdateOrder(currentOrderId, columns, newValues);
                     
                     string newLine;
                     for (size_t i = 0; i < values.get_size(); i++) {
@@ -653,20 +1058,35 @@ bool closeOrderWithTimestamp(DatabaseManager& dbManager, const string& orderId,
         in.close();
         out.close();
         
-        if (foundAndUpdated) {
+        if (updated) {
             remove(csvPath.c_str());
             rename(tmpPath.c_str(), csvPath.c_str());
-            return true;
+            markChunkDirty(tableName, fileIndex);
+            dbManager.bumpTableVersion(tableName);
+        }
+        else {
+            remove(tmpPath.c_str());
         }
-        
-        remove(tmpPath.c_str());
         fileIndex++;
     }
     
-    return false;
+    return updatedTotal;
+}
+
+bool updateOrderRow(DatabaseManager& dbManager, const string& orderId, const Vector<string>& columns, const Vector<string>& newValues) {
+    return updateOrderRows(dbManager, {orderId}, columns, newValues) == 1;
+}
+
+bool updateOrderQuantity(DatabaseManager& dbManager, const string& orderId, double newQuantity) {
+    return updateOrderRow(dbManager, orderId, {"quantity"}, {to_string(newQuantity)});
+}
+
+bool closeOrderWithTimestamp(DatabaseManager& dbManager, const string& orderId, const string& timestamp) {
+    string closeTime = timestamp.empty() ? getCurrentTimestamp() : timestamp;
+    return updateOrderRow(dbManager, orderId, {"closed"}, {closeTime});
 }
 
-void unlockFundsForOrder(DatabaseManager& dbManager, const string& userId, const string& orderType, const string& assetLot, const string& currencyLot, double quantity, double price) {
+void unlockFundsForOrder(const string& userId, const string& orderType, const string& assetLot, const string& currencyLot, double quantity, double price) {
     string lotToUnlock;
     double amountToUnlock;
     
@@ -679,336 +1099,477 @@ void unlockFundsForOrder(DatabaseManager& dbManager, const string& userId, const
         amountToUnlock = quantity;
     }
     
-    updateUserBalance(dbManager, userId, lotToUnlock, +amountToUnlock);
+    releaseFunds(userId, lotToUnlock, amountToUnlock);
 }
 
-string handleCreateOrder(DatabaseManager& dbManager, const string& body, const string& userKey) {
-    static mutex createOrderMutex;
-    lock_guard<mutex> lock(createOrderMutex);
-    try {
-        cout << "[INFO] Пользователь " << userKey << " создаёт ордер: " << body << endl;
-        
-        if (userKey.empty()) {
-            return makeHttpResponse(401, R"({"error": "Отсутствует заголовок X-USER-KEY"})");
+// Добавляет строку в таблицу order и возвращает ее order_id
+static int insertOrderRow(DatabaseManager& dbManager, const string& userId, const string& pairId, double quantity, double price, const string& type, const string& closed) {
+    TableLockGuard storageLock(dbManager, "order", LockMode::Exclusive, STORAGE_LOCK_TIMEOUT_MS);
+    string pkPath = dbManager.getSchemaName() + "/order/order_pk_sequence";
+    int orderPk = 1;
+    ifstream pkFile(pkPath);
+    if (pkFile.is_open()) {
+        pkFile >> orderPk;
+        pkFile.close();
+    }
+    int orderId = orderPk;
+
+    string orderQuery = "VALUES('" + userId + "','" + pairId + "','" + to_string(quantity) + "','" + to_string(price) + "','" + type + "','" + closed + "')";
+    insertData(dbManager, "order", orderQuery, orderPk);
+    indexAddOrder(IndexedOrder{orderId, userId, pairId, to_string(quantity), to_string(price), type, closed});
+    return orderId;
+}
+
+// Сделка только дописывается в конец таблицы trade и никогда не переписывается
+static void insertTradeRow(DatabaseManager& dbManager, const string& pairId, const string& buyOrderId, const string& sellOrderId, double price, double quantity, const string& timestamp) {
+    TableLockGuard storageLock(dbManager, "trade", LockMode::Exclusive, STORAGE_LOCK_TIMEOUT_MS);
+    string pkPath = dbManager.getSchemaName() + "/trade/trade_pk_sequence";
+    int tradePk = 1;
+    ifstream pkFile(pkPath);
+    if (pkFile.is_open()) {
+        pkFile >> tradePk;
+        pkFile.close();
+    }
+
+    string tradeQuery = "VALUES('" + pairId + "','" + buyOrderId + "','" + sellOrderId + "','" + to_string(price) + "','" + to_string(quantity) + "','" + timestamp + "')";
+    insertData(dbManager, "trade", tradeQuery, tradePk);
+}
+
+static void insertExpiryRow(DatabaseManager& dbManager, const string& orderId, long long expireAt) {
+    TableLockGuard storageLock(dbManager, "order_expiry", LockMode::Exclusive, STORAGE_LOCK_TIMEOUT_MS);
+    string pkPath = dbManager.getSchemaName() + "/order_expiry/order_expiry_pk_sequence";
+    int expiryPk = 1;
+    ifstream pkFile(pkPath);
+    if (pkFile.is_open()) {
+        pkFile >> expiryPk;
+        pkFile.close();
+    }
+
+    string expiryQuery = "VALUES('" + orderId + "','" + to_string(expireAt) + "')";
+    insertData(dbManager, "order_expiry", expiryQuery, expiryPk);
+}
+
+// Команды движков идут параллельно под разделяемой commandMtx, публикация среза берет ее монопольно.
+// Поэтому срез не застает команду другого движка на середине (строка ордера уже записана, а сделки и
+// балансы еще нет) и всегда лежит между целыми командами. Пока публикация ждет очереди, publishTurnMtx
+// не пускает новые команды, иначе движки могли бы откладывать ее бесконечно
+static shared_mutex commandMtx;
+static mutex publishTurnMtx;
+
+shared_lock<shared_mutex> beginCommand() {
+    lock_guard<mutex> turn(publishTurnMtx);
+    return shared_lock<shared_mutex>(commandMtx);
+}
+
+// Публикация среза под разделяемыми блокировками таблиц: архиватор и другие процессы не дописывают чанки в этот момент.
+// Таблицы берутся всегда в одном порядке, а писатели держат не больше одной, поэтому взаимной блокировки нет
+void publishTables(DatabaseManager& dbManager) {
+    lock_guard<mutex> turn(publishTurnMtx);
+    unique_lock<shared_mutex> betweenCommands(commandMtx);
+    TableLockGuard orderLock(dbManager, "order", LockMode::Shared, STORAGE_LOCK_TIMEOUT_MS);
+    TableLockGuard userLock(dbManager, "user", LockMode::Shared, STORAGE_LOCK_TIMEOUT_MS);
+    TableLockGuard tradeLock(dbManager, "trade", LockMode::Shared, STORAGE_LOCK_TIMEOUT_MS);
+    TableLockGuard expiryLock(dbManager, "order_expiry", LockMode::Shared, STORAGE_LOCK_TIMEOUT_MS);
+    lock_guard<mutex> accountsLock(accountsMutex());
+    publishSnapshot(dbManager);
+}
+
+// Числа приводятся к тому же виду, в каком они записываются в CSV
+static void reportExecution(const string& userId, const string& orderId, const string& pairId, const string& side, const string& status, double price, double lastQuantity, double lastPrice, double remaining) {
+    ExecutionReport report;
+    report.orderId = stoll(orderId);
+    report.pairId = pairId;
+    report.side = side;
+    report.status = status;
+    report.price = stod(to_string(price));
+    report.lastQuantity = stod(to_string(lastQuantity));
+    report.lastPrice = stod(to_string(lastPrice));
+    report.remaining = stod(to_string(remaining));
+    publishExecution(userId, report);
+}
+
+// Проверяет и исполняет заявку пользователя userId. Возвращает код ответа, тело ответа пишется в response
+// Вызывается только из потока секвенсора (sequencer.cpp), поэтому собственных блокировок не берет
+static int executeOrder(DatabaseManager& dbManager, const string& userId, const json& request, json& response) {
+    if (!hasField(request, "pair_id") || !hasField(request, "quantity") || 
+        !hasField(request, "price") || !hasField(request, "type")) {
+        response = {{"error", "Отсутствуют обязательные поля"}};
+        return 400;
+    }
+    
+    int pairIdInt = request["pair_id"].get<int>();
+    string pairId = to_string(pairIdInt);
+    double originalQuantity = request["quantity"].get<double>();
+    double ourPrice = request["price"].get<double>();
+    string orderType = request["type"].get<string>();
+    
+    if (orderType != "buy" && orderType != "sell") {
+        response = {{"error", "тип ордера только 'buy' или 'sell'"}};
+        return 400;
+    }
+    
+    // цена и объем приводятся к точности CSV: резерв и весь расчет по заявке считаются
+    // от тех же чисел, что окажутся в таблице и стакане
+    originalQuantity = stod(to_string(originalQuantity));
+    ourPrice = stod(to_string(ourPrice));
+    
+    if (originalQuantity <= 0 || ourPrice <= 0) {
+        response = {{"error", "запрос и цена должны быть положительными"}};
+        return 400;
+    }
+    
+    // GTC и GTT оставляют неисполненный остаток в стакане (GTT до expire_at), IOC снимает его сразу,
+    // FOK исполняется целиком или не исполняется вовсе
+    string timeInForce = hasField(request, "time_in_force") ? request["time_in_force"].get<string>() : "GTC";
+    if (timeInForce != "GTC" && timeInForce != "GTT" && timeInForce != "IOC" && timeInForce != "FOK") {
+        response = {{"error", "time_in_force только 'GTC', 'GTT', 'IOC' или 'FOK'"}};
+        return 400;
+    }
+    
+    long long expireAt = 0;
+    if (timeInForce == "GTT") {
+        if (!hasField(request, "expire_at")) {
+            response = {{"error", "Для GTT нужен expire_at"}};
+            return 400;
         }
-        
-        string userId = getUserIdByKey(dbManager, userKey);
-        if (userId.empty()) {
-            return makeHttpResponse(403, R"({"error": "Неверный ключ пользователя"})");
+        expireAt = request["expire_at"].get<long long>();
+        if (expireAt <= stoll(getCurrentTimestamp())) {
+            response = {{"error", "Срок expire_at уже наступил"}};
+            return 400;
         }
-        
-        json request = parseJsonBody(body);
-        if (!hasField(request, "pair_id") || !hasField(request, "quantity") || 
-            !hasField(request, "price") || !hasField(request, "type")) {
-            return makeHttpResponse(400, R"({"error": "Отсутствуют обязательные поля"})");
+    }
+    bool restsInBook = timeInForce == "GTC" || timeInForce == "GTT";
+    
+    Vector<string> pairSelectCol = {"pair.first_lot_id", "pair.second_lot_id"};
+    Vector<string> pairTables = {"pair"};
+    Vector<Condition> pairCond;
+    pairCond.push_back(Condition{"pair.pair_id", pairId, "="});
+    
+    Vector<string> pairResults;
+    selectDataCapture(dbManager, pairSelectCol, pairTables, pairCond, pairResults);
+    
+    if (pairResults.empty()) {
+        response = {{"error", "Пара не найдена"}};
+        return 404;
+    }
+    
+    stringstream pairSS(pairResults[0]);
+    string assetLot, currencyLot;
+    getline(pairSS, assetLot, ',');
+    getline(pairSS, currencyLot, ',');
+    
+    string oppositeType = (orderType == "buy") ? "sell" : "buy";
+    
+    // встречные заявки берутся из стакана в памяти, уже в порядке приоритета исполнения
+    Vector<BookOrder> candidates = bookMatchCandidates(pairId, oppositeType, ourPrice, EPSILON);
+    
+    Vector<string> matchingOrderIds;
+    Vector<string> matchingUserIds;
+    Vector<double> matchingQuantities;
+    Vector<double> matchingPrices;
+    
+    for (size_t i = 0; i < candidates.get_size(); i++) {
+        if (candidates[i].userId == userId || candidates[i].quantity <= EPSILON) {
+            continue;
         }
-        
-        int pairIdInt = request["pair_id"].get<int>();
-        string pairId = to_string(pairIdInt);
-        double originalQuantity = request["quantity"].get<double>();
-        double ourPrice = request["price"].get<double>();
-        string orderType = request["type"].get<string>();
-        
-        if (orderType != "buy" && orderType != "sell") {
-            return makeHttpResponse(400, R"({"error": "тип ордера только 'buy' или 'sell'"})");
+        matchingOrderIds.push_back(to_string(candidates[i].orderId));
+        matchingUserIds.push_back(candidates[i].userId);
+        matchingQuantities.push_back(candidates[i].quantity);
+        matchingPrices.push_back(candidates[i].price);
+    }
+    
+    if (timeInForce == "FOK") {
+        double available = 0;
+        for (size_t i = 0; i < matchingQuantities.get_size(); i++) {
+            available += matchingQuantities[i];
         }
-        
-        if (originalQuantity <= 0 || ourPrice <= 0) {
-            return makeHttpResponse(400, R"({"error": "запрос и цена должны быть положительными"})");
+        if (available < originalQuantity - EPSILON) {
+            response = {{"status", "killed"}, {"filled", 0}};
+            return 200;
         }
+    }
+    
+    string reserveLot = orderType == "buy" ? currencyLot : assetLot;
+    double reserveAmount = orderType == "buy" ? originalQuantity * ourPrice : originalQuantity;
+    double currentBalance = accountBalance(userId, reserveLot);
+    if (currentBalance + EPSILON < reserveAmount) {
+        response = {{"error", "Недостаточно средств"}, {"запрошено", reserveAmount}, {"доступно", currentBalance}};
+        return 400;
+    }
+    
+    double remainingQuantity = originalQuantity;
+    double executedQuantity = 0;
+    double totalExecutedValue = 0;
+    bool anyTradeExecuted = false;
+    // Резерв заявки и изменения балансов всех участников копятся и применяются одним расчетом.
+    // До его успеха не меняются ни таблицы, ни стакан, ни отчеты об исполнении
+    Vector<BalanceDelta> settlement;
+    settlement.push_back(BalanceDelta{userId, reserveLot, -reserveAmount, reserveAmount});
+    // Исполнения встречных заявок применяются после расчета, сделки — после вставки заявки,
+    // когда известен ее order_id
+    Vector<string> tradeMakerIds;
+    Vector<string> tradeMakerUsers;
+    Vector<double> tradeMakerPrices;
+    Vector<double> tradeMakerRemaining;
+    Vector<double> tradePrices;
+    Vector<double> tradeQuantities;
+    
+    for (size_t i = 0; i < matchingOrderIds.get_size() && remainingQuantity > EPSILON; i++) {
+        string matchOrderId = matchingOrderIds[i];
+        string matchUserId = matchingUserIds[i];
+        double matchQuantity = matchingQuantities[i];
+        double executionPrice = (orderType == "buy") ? matchingPrices[i] : ourPrice;
         
-        Vector<string> pairSelectCol = {"pair.first_lot_id", "pair.second_lot_id"};
-        Vector<string> pairTables = {"pair"};
-        Vector<Condition> pairCond;
-        pairCond.push_back(Condition{"pair.pair_id", pairId, "="});
-        
-        Vector<string> pairResults;
-        selectDataCapture(dbManager, pairSelectCol, pairTables, pairCond, pairResults);
-        
-        if (pairResults.empty()) {
-            return makeHttpResponse(404, R"({"error": "Пара не найдена"})");
-        }
+        double tradeQuantity = min(remainingQuantity, matchQuantity);
+        double tradeValue = tradeQuantity * executionPrice;
         
-        stringstream pairSS(pairResults[0]);
-        string assetLot, currencyLot;
-        getline(pairSS, assetLot, ',');
-        getline(pairSS, currencyLot, ',');
+        totalExecutedValue += tradeValue;
+        anyTradeExecuted = true;
         
         if (orderType == "buy") {
-            double lockedAmount = originalQuantity * ourPrice;
-            double currentBalance = getUserBalance(dbManager, userId, currencyLot);
-            if (currentBalance < lockedAmount) {
-                json error = {{"error", "Недостаточно средств"}, {"запрошено", lockedAmount}, {"доступно", currentBalance}};
-                return makeHttpResponse(400, error.dump(4));
-            }
+            settlement.push_back(BalanceDelta{userId, currencyLot, 0, -tradeValue});
+            settlement.push_back(BalanceDelta{userId, assetLot, tradeQuantity, 0});
+            settlement.push_back(BalanceDelta{matchUserId, assetLot, 0, -tradeQuantity});
+            settlement.push_back(BalanceDelta{matchUserId, currencyLot, tradeValue, 0});
             
-            updateUserBalance(dbManager, userId, currencyLot, -lockedAmount);
-        } else if (orderType == "sell") {
-            double currentBalance = getUserBalance(dbManager, userId, assetLot);
-            if (currentBalance < originalQuantity) {
-                json error = {{"error", "Недостаточно средств"}, {"запрошено", originalQuantity}, {"доступно", currentBalance}};
-                return makeHttpResponse(400, error.dump(4));
+            double sellOrderPrice = matchingPrices[i];
+            if (sellOrderPrice < executionPrice + EPSILON) {
+                double excessPerUnit = executionPrice - sellOrderPrice;
+                double totalExcess = tradeQuantity * excessPerUnit;
+                settlement.push_back(BalanceDelta{userId, currencyLot, totalExcess, -totalExcess});
             }
+        }
+        else if (orderType == "sell") {
+            settlement.push_back(BalanceDelta{userId, assetLot, 0, -tradeQuantity});
+            settlement.push_back(BalanceDelta{userId, currencyLot, tradeValue, 0});
+            settlement.push_back(BalanceDelta{matchUserId, currencyLot, 0, -tradeValue});
+            settlement.push_back(BalanceDelta{matchUserId, assetLot, tradeQuantity, 0});
             
-            updateUserBalance(dbManager, userId, assetLot, -originalQuantity);
+            double buyOrderPrice = matchingPrices[i];
+            if (buyOrderPrice > executionPrice + EPSILON) {
+                double excessPerUnit = buyOrderPrice - executionPrice;
+                double totalExcess = tradeQuantity * excessPerUnit;
+                settlement.push_back(BalanceDelta{matchUserId, currencyLot, totalExcess, -totalExcess});
+            }
         }
         
-        string oppositeType = (orderType == "buy") ? "sell" : "buy";
+        tradeMakerIds.push_back(matchOrderId);
+        tradeMakerUsers.push_back(matchUserId);
+        tradeMakerPrices.push_back(matchingPrices[i]);
+        tradeMakerRemaining.push_back(matchQuantity - tradeQuantity);
+        tradePrices.push_back(executionPrice);
+        tradeQuantities.push_back(tradeQuantity);
+        remainingQuantity -= tradeQuantity;
+        executedQuantity += tradeQuantity;
+    }
+    
+    if (anyTradeExecuted) {
+        if (orderType == "buy") {
+            double initiallyLocked = originalQuantity * ourPrice;
+            double actuallySpent = totalExecutedValue;
+            double amountToReturn = initiallyLocked - actuallySpent - (remainingQuantity * ourPrice);
+            
+            if (amountToReturn > EPSILON) {
+                settlement.push_back(BalanceDelta{userId, currencyLot, amountToReturn, -amountToReturn});
+            }
+        }
+    }
+    
+    // остаток IOC (и FOK при расхождении округления) в стакан не встает: его резерв возвращается сразу
+    if (!restsInBook && remainingQuantity > EPSILON) {
+        double unlock = orderType == "buy" ? remainingQuantity * ourPrice : remainingQuantity;
+        settlement.push_back(BalanceDelta{userId, reserveLot, unlock, -unlock});
+    }
+    
+    if (!settleBalances(settlement)) {
+        response = {{"error", "Недостаточно средств"}, {"запрошено", reserveAmount}, {"доступно", accountBalance(userId, reserveLot)}};
+        return 400;
+    }
+    
+    for (size_t i = 0; i < tradeMakerIds.get_size(); i++) {
+        const string& makerId = tradeMakerIds[i];
+        double remaining = tradeMakerRemaining[i];
+        if (remaining <= EPSILON) {
+            closeOrderWithTimestamp(dbManager, makerId);
+            bookFillOrder(makerId, tradeQuantities[i], tradePrices[i], 0);
+            reportExecution(tradeMakerUsers[i], makerId, pairId, oppositeType, "filled", tradeMakerPrices[i], tradeQuantities[i], tradePrices[i], 0);
+        } 
+        else {
+            updateOrderQuantity(dbManager, makerId, remaining);
+            bookFillOrder(makerId, tradeQuantities[i], tradePrices[i], stod(to_string(remaining)));
+            reportExecution(tradeMakerUsers[i], makerId, pairId, oppositeType, "partial", tradeMakerPrices[i], tradeQuantities[i], tradePrices[i], remaining);
+        }
+    }
+    
+    int responseId;
+    
+    string tradeTime = getCurrentTimestamp();
+    
+    if (!restsInBook && remainingQuantity > EPSILON) {
+        if (executedQuantity <= EPSILON) {
+            response = {{"status", "killed"}, {"filled", 0}};
+            return 200;
+        }
+        double avgExecutionPrice = totalExecutedValue / executedQuantity;
+        responseId = insertOrderRow(dbManager, userId, pairId, executedQuantity, ourPrice, orderType, tradeTime);
+        reportExecution(userId, to_string(responseId), pairId, orderType, "partial", ourPrice, executedQuantity, avgExecutionPrice, 0);
+        
+    } else if (executedQuantity > EPSILON && remainingQuantity > EPSILON) {
+        double avgExecutionPrice = totalExecutedValue / executedQuantity;
+        responseId = insertOrderRow(dbManager, userId, pairId, remainingQuantity, ourPrice, orderType, "");
+        bookAddOrder(to_string(responseId), userId, pairId, orderType, stod(to_string(ourPrice)), stod(to_string(remainingQuantity)));
+        reportExecution(userId, to_string(responseId), pairId, orderType, "partial", ourPrice, executedQuantity, avgExecutionPrice, remainingQuantity);
+             
+    } else if (executedQuantity > EPSILON) {
+        double avgExecutionPrice = totalExecutedValue / executedQuantity;
+        responseId = insertOrderRow(dbManager, userId, pairId, originalQuantity, ourPrice, orderType, tradeTime);
+        reportExecution(userId, to_string(responseId), pairId, orderType, "filled", ourPrice, executedQuantity, avgExecutionPrice, 0);
+             
+    } else {
+        responseId = insertOrderRow(dbManager, userId, pairId, originalQuantity, ourPrice, orderType, "");
+        bookAddOrder(to_string(responseId), userId, pairId, orderType, stod(to_string(ourPrice)), stod(to_string(originalQuantity)));
+        reportExecution(userId, to_string(responseId), pairId, orderType, "accepted", ourPrice, 0, 0, originalQuantity);
+    }
+    
+    for (size_t i = 0; i < tradeMakerIds.get_size(); i++) {
+        string takerId = to_string(responseId);
+        const string& buyOrderId = orderType == "buy" ? takerId : tradeMakerIds[i];
+        const string& sellOrderId = orderType == "buy" ? tradeMakerIds[i] : takerId;
+        insertTradeRow(dbManager, pairId, buyOrderId, sellOrderId, tradePrices[i], tradeQuantities[i], tradeTime);
+    }
+    
+    if (timeInForce == "GTT" && remainingQuantity > EPSILON) {
+        insertExpiryRow(dbManager, to_string(responseId), expireAt);
+        scheduleOrderExpiry(to_string(responseId), pairId, expireAt);
+    }
+    
+    response["order_id"] = responseId;
+    if (!restsInBook) {
+        response["filled"] = executedQuantity;
+    }
+    return 201;
+}
+
+string handleCreateOrder(DatabaseManager& dbManager, const string& body, const string& userKey) {
+    try {
+        cout << "[INFO] Пользователь " << userKey << " создаёт ордер: " << body << endl;
         
-        Vector<string> selectCol = {
-            "order.order_id", 
-            "order.user_id", 
-            "order.quantity", 
-            "order.price", 
-            "order.type",
-            "order.closed"
-        };
-        Vector<string> tables = {"order"};
-        Vector<Condition> cond;
-        cond.push_back(Condition{"order.pair_id", pairId, "="});
-        cond.push_back(Condition{"order.type", oppositeType, "="});
-        cond.push_back(Condition{"order.closed", "", "="});
+        if (userKey.empty()) {
+            return makeHttpResponse(401, R"({"error": "Отсутствует заголовок X-USER-KEY"})");
+        }
         
-        Vector<string> results;
-        selectDataCapture(dbManager, selectCol, tables, cond, results);
+        string userId = getUserIdByKey(dbManager, *acquireSnapshot(), userKey);
+        if (userId.empty()) {
+            return makeHttpResponse(403, R"({"error": "Неверный ключ пользователя"})");
+        }
         
-        Vector<string> matchingOrderIds;
-        Vector<string> matchingUserIds;
-        Vector<double> matchingQuantities;
-        Vector<double> matchingPrices;
+        json request = parseJsonBody(body);
+        json response;
+        int status = executeOrder(dbManager, userId, request, response);
+        return makeHttpResponse(status, response.dump());
         
-        for (size_t i = 0; i < results.get_size(); i++) {
-            stringstream ss(results[i]);
-            string orderId, matchUserId, qtyStr, priceStr, type, closed;
-            
-            getline(ss, orderId, ',');
-            getline(ss, matchUserId, ',');
-            getline(ss, qtyStr, ',');
-            getline(ss, priceStr, ',');
-            getline(ss, type, ',');
-            getline(ss, closed, ',');
-
-            auto isReallyEmpty = [](const string& s) -> bool {
-                if (s.empty()) return true;
-                for (char c : s) {
-                    if (!isspace(static_cast<unsigned char>(c))) {
-                        return false;
-                    }
-                }
-                return true;
-            };
+    } catch (const exception& e) {
+        json error = {{"error", "Internal server error22"}, {"message", e.what()}};
+        return makeHttpResponse(500, error.dump());
+    }
+}
 
-            if (!isReallyEmpty(closed)) {
-                continue;
-            }
+// Часть пачки, попавшая в один движок: {"user_id": ..., "orders": [...]}. Заявки исполняются по порядку
+// за один ход движка; результат — массив ответов на каждую заявку с полем status.
+string applyOrderBatch(DatabaseManager& dbManager, const string& body) {
+    json results = json::array();
+    try {
+        json request = parseJsonBody(body);
+        string userId = request["user_id"].get<string>();
 
-            if (matchUserId == userId) {
-                continue;
+        for (const json& order : request["orders"]) {
+            json result;
+            int status;
+            try {
+                status = executeOrder(dbManager, userId, order, result);
             }
-            
-            double matchQuantity = stod(qtyStr);
-            double matchPrice = stod(priceStr);
-            
-            bool priceMatch = false;
-            if (orderType == "buy") {
-                priceMatch = (matchPrice <= ourPrice + EPSILON);
-            } else {
-                priceMatch = (matchPrice >= ourPrice - EPSILON);
+            catch (const exception& e) {
+                status = 500;
+                result = {{"error", "Internal server error103"}, {"message", e.what()}};
             }
+            result["status"] = status;
+            results.push_back(result);
+        }
+    }
+    catch (const exception& e) {
+        cerr << "[ERROR] Не удалось исполнить пачку ордеров: " << e.what() << endl;
+    }
+    return results.dump();
+}
 
-            if (orderType == type) { 
-                continue;  
-            }
-            
-            if (priceMatch && matchQuantity > EPSILON) {
-                matchingOrderIds.push_back(orderId);
-                matchingUserIds.push_back(matchUserId);
-                matchingQuantities.push_back(matchQuantity);
-                matchingPrices.push_back(matchPrice);
-            }
+string handleCreateOrderBatch(DatabaseManager& dbManager, const string& body, const string& userKey) {
+    try {
+        cout << "[INFO] Пользователь " << userKey << " создаёт пачку ордеров" << endl;
+
+        if (userKey.empty()) {
+            return makeHttpResponse(401, R"({"error": "Отсутствует заголовок X-USER-KEY"})");
         }
-        
-        if (orderType == "buy") {
-            for (size_t i = 0; i < matchingOrderIds.get_size(); i++) {
-                for (size_t j = i + 1; j < matchingOrderIds.get_size(); j++) {
-                    if (matchingPrices[j] < matchingPrices[i]) {
-                        swap(matchingOrderIds[i], matchingOrderIds[j]);
-                        swap(matchingUserIds[i], matchingUserIds[j]);
-                        swap(matchingQuantities[i], matchingQuantities[j]);
-                        swap(matchingPrices[i], matchingPrices[j]);
-                    }
-                }
-            }
+
+        string userId = getUserIdByKey(dbManager, *acquireSnapshot(), userKey);
+        if (userId.empty()) {
+            return makeHttpResponse(403, R"({"error": "Неверный ключ пользователя"})");
         }
-        
-        double remainingQuantity = originalQuantity;
-        double executedQuantity = 0;
-        double totalExecutedValue = 0;
-        bool anyTradeExecuted = false;
-        
-        for (size_t i = 0; i < matchingOrderIds.get_size() && remainingQuantity > EPSILON; i++) {
-            string matchOrderId = matchingOrderIds[i];
-            string matchUserId = matchingUserIds[i];
-            double matchQuantity = matchingQuantities[i];
-            double executionPrice = (orderType == "buy") ? matchingPrices[i] : ourPrice;
-            
-            double tradeQuantity = min(remainingQuantity, matchQuantity);
-            double tradeValue = tradeQuantity * executionPrice;
-            
-            totalExecutedValue += tradeValue;
-            anyTradeExecuted = true;
-            
-            if (orderType == "buy") {
-                updateUserBalance(dbManager, userId, assetLot, +tradeQuantity);
-                updateUserBalance(dbManager, matchUserId, currencyLot, +tradeValue);
-                
-                Vector<string> sellOrderSelectCol = {"order.price"};
-                Vector<string> sellOrderTables = {"order"};
-                Vector<Condition> sellOrderCond;
-                sellOrderCond.push_back(Condition{"order.order_id", matchOrderId, "="});
-                
-                Vector<string> sellOrderResults;
-                selectDataCapture(dbManager, sellOrderSelectCol, sellOrderTables, sellOrderCond, sellOrderResults);
-                
-                if (!sellOrderResults.empty()) {
-                    stringstream sellOrderSS(sellOrderResults[0]);
-                    string sellOrderPriceStr;
-                    getline(sellOrderSS, sellOrderPriceStr, ',');
-                    
-                    double sellOrderPrice = stod(sellOrderPriceStr);
-                    if (sellOrderPrice < executionPrice + EPSILON) {
-                        double excessPerUnit = executionPrice - sellOrderPrice;
-                        double totalExcess = tradeQuantity * excessPerUnit;
-                        updateUserBalance(dbManager, userId, currencyLot, +totalExcess);
-                    }
-                }
-            }
-            else if (orderType == "sell") {
-                updateUserBalance(dbManager, userId, currencyLot, +tradeValue);
-                updateUserBalance(dbManager, matchUserId, assetLot, +tradeQuantity);
-                
-                Vector<string> buyOrderSelectCol = {"order.price"};
-                Vector<string> buyOrderTables = {"order"};
-                Vector<Condition> buyOrderCond;
-                buyOrderCond.push_back(Condition{"order.order_id", matchOrderId, "="});
-                
-                Vector<string> buyOrderResults;
-                selectDataCapture(dbManager, buyOrderSelectCol, buyOrderTables, buyOrderCond, buyOrderResults);
-                
-                if (!buyOrderResults.empty()) {
-                    stringstream buyOrderSS(buyOrderResults[0]);
-                    string buyOrderPriceStr;
-                    getline(buyOrderSS, buyOrderPriceStr, ',');
-                    
-                    double buyOrderPrice = stod(buyOrderPriceStr);
-                    if (buyOrderPrice > executionPrice + EPSILON) {
-                        double excessPerUnit = buyOrderPrice - executionPrice;
-                        double totalExcess = tradeQuantity * excessPerUnit;
-                        updateUserBalance(dbManager, matchUserId, currencyLot, +totalExcess);
-                    }
-                }
-            }
-            
-            double newMatchQuantity = matchQuantity - tradeQuantity;
-            
-            if (newMatchQuantity <= EPSILON) {
-                closeOrderWithTimestamp(dbManager, matchOrderId);
-            } 
-            else {
-                updateOrderQuantity(dbManager, matchOrderId, newMatchQuantity);
-                    
-                string pkPath = dbManager.getSchemaName() + "/order/order_pk_sequence";
-                int newPk = 1;
-                ifstream pkFile(pkPath);
-                if (pkFile.is_open()) {
-                    pkFile >> newPk;
-                    pkFile.close();
-                }
-                
-                string closedField = getCurrentTimestamp();
-                string executionPriceStr = to_string(executionPrice);
-                string orderQuery = "VALUES('" + matchUserId + "','" + pairId + "','" + to_string(tradeQuantity) + "','" + executionPriceStr + "','" + oppositeType + "','" + closedField + "')";
-                    
-                insertData(dbManager, "order", orderQuery, newPk);
+
+        json request = parseJsonBody(body);
+        if (!request.is_array() || request.empty()) {
+            return makeHttpResponse(400, R"({"error": "Ожидается непустой массив ордеров"})");
+        }
+        if (request.size() > MAX_ORDER_BATCH) {
+            json error = {{"error", "Слишком много ордеров в пачке"}, {"максимум", MAX_ORDER_BATCH}};
+            return makeHttpResponse(400, error.dump());
+        }
+
+        // Заявки раскладываются по движкам их пар с сохранением порядка: каждый движок исполняет
+        // свою часть одной командой, а ответы собираются обратно в порядке запроса
+        size_t shardCount = engineShardCount();
+        Vector<json> parts(shardCount);
+        Vector<Vector<size_t>> positions(shardCount);
+        for (size_t i = 0; i < shardCount; i++) {
+            parts[i] = {{"user_id", userId}, {"orders", json::array()}};
+        }
+
+        for (size_t i = 0; i < request.size(); i++) {
+            size_t shard = 0;
+            if (request[i].is_object() && hasField(request[i], "pair_id") && request[i]["pair_id"].is_number_integer()) {
+                shard = shardForPair(to_string(request[i]["pair_id"].get<int>()));
             }
-            
-            remainingQuantity -= tradeQuantity;
-            executedQuantity += tradeQuantity;
+            parts[shard]["orders"].push_back(request[i]);
+            positions[shard].push_back(i);
         }
-        
-        if (anyTradeExecuted) {
-            if (orderType == "buy") {
-                double initiallyLocked = originalQuantity * ourPrice;
-                double actuallySpent = totalExecutedValue;
-                double amountToReturn = initiallyLocked - actuallySpent - (remainingQuantity * ourPrice);
-                
-                if (amountToReturn > EPSILON) {
-                    updateUserBalance(dbManager, userId, currencyLot, +amountToReturn);
-                }
+
+        Vector<future<string>> pending(shardCount);
+        for (size_t i = 0; i < shardCount; i++) {
+            if (!positions[i].empty()) {
+                pending[i] = submitCommand(i, CommandType::CreateOrderBatch, parts[i].dump(), userKey);
             }
         }
-        
-        int responseId;
-        
-        if (executedQuantity > EPSILON && remainingQuantity > EPSILON) {
-            double avgExecutionPrice = totalExecutedValue / executedQuantity;
-            
-            string pkPath = dbManager.getSchemaName() + "/order/order_pk_sequence";
-            int orderPk = 1;
-            ifstream pkFile(pkPath);
-            if (pkFile.is_open()) {
-                pkFile >> orderPk;
-                pkFile.close();
+
+        json results(request.size(), nullptr);
+        for (size_t i = 0; i < shardCount; i++) {
+            if (positions[i].empty()) {
+                continue;
             }
-            responseId = orderPk;
-            
-            string closedField = getCurrentTimestamp();
-            string orderQuery = "VALUES('" + userId + "','" + pairId + "','" + to_string(executedQuantity) + "','" + to_string(avgExecutionPrice) + "','" + orderType + "','" + closedField + "')";
-            
-            insertData(dbManager, "order", orderQuery, orderPk);
-            
-            closedField = "";
-            orderQuery = "VALUES('" + userId + "','" + pairId + "','" + to_string(remainingQuantity) + "','" + to_string(ourPrice) + "','" + orderType + "','" + closedField + "')";
-            insertData(dbManager, "order", orderQuery, orderPk);
-                 
-        } else if (executedQuantity > EPSILON) {
-            string pkPath = dbManager.getSchemaName() + "/order/order_pk_sequence";
-            int orderPk = 1;
-            ifstream pkFile(pkPath);
-            if (pkFile.is_open()) {
-                pkFile >> orderPk;
-                pkFile.close();
+            json partResults = json::parse(pending[i].get());
+            if (partResults.size() != positions[i].get_size()) {
+                throw runtime_error("Движок вернул неполный ответ на пачку ордеров");
             }
-            responseId = orderPk;
-            
-            double avgExecutionPrice = totalExecutedValue / executedQuantity;
-            string closedField = getCurrentTimestamp();
-            string orderQuery = "VALUES('" + userId + "','" + pairId + "','" + to_string(executedQuantity) + "','" + to_string(avgExecutionPrice) + "','" + orderType + "','" + closedField + "')";
-            insertData(dbManager, "order", orderQuery, orderPk);
-                 
-        } else {
-            string pkPath = dbManager.getSchemaName() + "/order/order_pk_sequence";
-            int orderPk = 1;
-            ifstream pkFile(pkPath);
-            if (pkFile.is_open()) {
-                pkFile >> orderPk;
-                pkFile.close();
+            for (size_t j = 0; j < positions[i].get_size(); j++) {
+                results[positions[i][j]] = partResults[j];
             }
-            responseId = orderPk;
-            
-            string closedField = "";
-            string orderQuery = "VALUES('" + userId + "','" + pairId + "','" + to_string(originalQuantity) + "','" + to_string(ourPrice) + "','" + orderType + "','" + closedField + "')";
-            insertData(dbManager, "order", orderQuery, orderPk);
         }
-        
+
         json response;
-        response["order_id"] = responseId;
+        response["results"] = results;
+        return makeHttpResponse(200, response.dump());
 
-        return makeHttpResponse(201, response.dump(4));
-        
     } catch (const exception& e) {
-        json error = {{"error", "Internal server error22"}, {"message", e.what()}};
-        return makeHttpResponse(500, error.dump(4));
+        json error = {{"error", "Internal server error104"}, {"message", e.what()}};
+        return makeHttpResponse(500, error.dump());
     }
 }
 
@@ -1040,7 +1601,7 @@ string handleDeleteOrder(DatabaseManager& dbManager, const string& body, const s
             return makeHttpResponse(401, R"({"error": "Нет заголовка X-USER-KEY"})");
         }
         
-        string userId = getUserIdByKey(dbManager, userKey);
+        string userId = getUserIdByKey(dbManager, *acquireSnapshot(), userKey);
         if (userId.empty()) {
             return makeHttpResponse(403, R"({"error": "Неверный ключ пользователя"})");
         }
@@ -1052,56 +1613,245 @@ string handleDeleteOrder(DatabaseManager& dbManager, const string& body, const s
         
         string orderId = to_string(request["order_id"].get<int>());
         
-        if (!canDeleteOrder(dbManager, orderId, userId)) {
+        // открытые ордера есть только в стакане, а стакан пары меняет лишь ее движок
+        BookOrder order;
+        string pairId, orderType;
+        if (!bookFindOrder(orderId, order, pairId, orderType) || order.userId != userId) {
             return makeHttpResponse(403, R"({"error": "Удаление данного ордера невозможно"})");
         }
         
-        Vector<string> selectCol = {
-            "order.user_id", 
-            "order.pair_id", 
-            "order.quantity", 
-            "order.price", 
-            "order.type"
-        };
-        Vector<string> tables = {"order"};
-        Vector<Condition> cond;
-        cond.push_back(Condition{"order.order_id", orderId, "="});
-        
-        Vector<string> results;
-        selectDataCapture(dbManager, selectCol, tables, cond, results);
-        
-        if (results.empty()) {
-            return makeHttpResponse(404, R"({"error": "Ордер не найден"})");
-        }
-        
-        stringstream ss(results[0]);
-        string orderUserId, pairId, orderQuantity, orderPrice, orderType;
-        getline(ss, orderUserId, ',');
-        getline(ss, pairId, ',');
-        getline(ss, orderQuantity, ',');
-        getline(ss, orderPrice, ',');
-        getline(ss, orderType, ',');
-        
-        double quantity = stod(orderQuantity);
-        double price = stod(orderPrice);
+        double quantity = order.quantity;
+        double price = order.price;
         
         PairInfo pair = getPairInfo(dbManager, pairId);
         if (!pair.firstLotId.empty() && !pair.secondLotId.empty()) {
             string assetLot = pair.firstLotId;
             string currencyLot = pair.secondLotId;
             
-            unlockFundsForOrder(dbManager, userId, orderType, assetLot, currencyLot, quantity, price);
+            unlockFundsForOrder(userId, orderType, assetLot, currencyLot, quantity, price);
         }
         
         closeOrderWithTimestamp(dbManager, orderId);
+        bookCancelOrder(orderId);
+        reportExecution(userId, orderId, pairId, orderType, "cancelled", price, 0, 0, quantity);
         
         json response;
         response["order_id"] = stoi(orderId);
         
-        return makeHttpResponse(200, response.dump(4));
+        return makeHttpResponse(200, response.dump());
         
     } catch (const exception& e) {
         json error = {{"error", "Internal server error11"}, {"message", e.what()}};
-        return makeHttpResponse(500, error.dump(4));
+        return makeHttpResponse(500, error.dump());
+    }
+}
+
+// Меняет цену и/или объем открытой заявки на месте: блокировка средств меняется только на разницу
+// между новым и прежним резервом. Новая цена не должна пересекать чужие встречные заявки —
+// такое изменение было бы новой сделкой, для него заявку нужно снять и выставить заново.
+string handleAmendOrder(DatabaseManager& dbManager, const string& body, const string& userKey) {
+    try {
+        cout << "[INFO] Пользователь " << userKey << " изменяет ордер: " << body << endl;
+        
+        if (userKey.empty()) {
+            return makeHttpResponse(401, R"({"error": "Нет заголовка X-USER-KEY"})");
+        }
+        
+        string userId = getUserIdByKey(dbManager, *acquireSnapshot(), userKey);
+        if (userId.empty()) {
+            return makeHttpResponse(403, R"({"error": "Неверный ключ пользователя"})");
+        }
+        
+        json request = parseJsonBody(body);
+        if (!hasField(request, "order_id")) {
+            return makeHttpResponse(400, R"({"error": "Отсутствует order_id"})");
+        }
+        if (!hasField(request, "price") && !hasField(request, "quantity")) {
+            return makeHttpResponse(400, R"({"error": "Нужно указать price или quantity"})");
+        }
+        
+        string orderId = to_string(request["order_id"].get<int>());
+        
+        BookOrder order;
+        string pairId, orderType;
+        if (!bookFindOrder(orderId, order, pairId, orderType) || order.userId != userId) {
+            return makeHttpResponse(403, R"({"error": "Изменение данного ордера невозможно"})");
+        }
+        
+        double newPrice = hasField(request, "price") ? stod(to_string(request["price"].get<double>())) : order.price;
+        double newQuantity = hasField(request, "quantity") ? stod(to_string(request["quantity"].get<double>())) : order.quantity;
+        if (newQuantity <= 0 || newPrice <= 0) {
+            return makeHttpResponse(400, R"({"error": "запрос и цена должны быть положительными"})");
+        }
+        
+        string oppositeType = orderType == "buy" ? "sell" : "buy";
+        Vector<BookOrder> crossing = bookMatchCandidates(pairId, oppositeType, newPrice, EPSILON);
+        for (size_t i = 0; i < crossing.get_size(); i++) {
+            if (crossing[i].userId != userId) {
+                return makeHttpResponse(409, R"({"error": "Новая цена пересекает встречные заявки"})");
+            }
+        }
+        
+        PairInfo pair = getPairInfo(dbManager, pairId);
+        if (pair.firstLotId.empty() || pair.secondLotId.empty()) {
+            return makeHttpResponse(404, R"({"error": "Пара не найдена"})");
+        }
+        
+        string lockLot = orderType == "buy" ? pair.secondLotId : pair.firstLotId;
+        double lockDelta = orderType == "buy" ? newQuantity * newPrice - order.quantity * order.price : newQuantity - order.quantity;
+        
+        Vector<BalanceDelta> settlement;
+        settlement.push_back(BalanceDelta{userId, lockLot, -lockDelta, lockDelta});
+        if (!settleBalances(settlement)) {
+            json error = {{"error", "Недостаточно средств"}, {"запрошено", lockDelta}};
+            return makeHttpResponse(400, error.dump());
+        }
+        
+        updateOrderRow(dbManager, orderId, {"price", "quantity"}, {to_string(newPrice), to_string(newQuantity)});
+        bookAmendOrder(orderId, newPrice, newQuantity);
+        reportExecution(userId, orderId, pairId, orderType, "amended", newPrice, 0, 0, newQuantity);
+        
+        json response;
+        response["order_id"] = stoi(orderId);
+        response["price"] = newPrice;
+        response["quantity"] = newQuantity;
+        
+        return makeHttpResponse(200, response.dump());
+        
+    } catch (const exception& e) {
+        json error = {{"error", "Internal server error105"}, {"message", e.what()}};
+        return makeHttpResponse(500, error.dump());
     }
-}
\ No newline at end of file
+}
+
+// Часть массовой отмены, попавшая в один движок: {"user_id": ..., "order_ids": [...]}.
+// Без user_id снимаются заявки любых владельцев (так снимаются истекшие GTT, status: "expired").
+// Средства всех заявок возвращаются одним расчетом, строки закрываются одним проходом по таблице.
+// Результат — массив снятых order_id (заявки, исполненные до хода движка, пропускаются)
+string applyCancelOrders(DatabaseManager& dbManager, const string& body) {
+    json cancelled = json::array();
+    try {
+        json request = parseJsonBody(body);
+        string userId = hasField(request, "user_id") ? request["user_id"].get<string>() : "";
+        string status = hasField(request, "status") ? request["status"].get<string>() : "cancelled";
+
+        HashTable<string, PairInfo> pairs;
+        Vector<string> orderIds;
+        Vector<BookOrder> orders;
+        Vector<string> orderPairs;
+        Vector<string> orderTypes;
+        Vector<BalanceDelta> refunds;
+
+        for (const json& id : request["order_ids"]) {
+            string orderId = to_string(id.get<long long>());
+            BookOrder order;
+            string pairId, orderType;
+            if (!bookFindOrder(orderId, order, pairId, orderType) || (!userId.empty() && order.userId != userId)) {
+                continue;
+            }
+
+            if (!pairs.contains(pairId)) {
+                pairs.insert(pairId, getPairInfo(dbManager, pairId));
+            }
+            const PairInfo& pair = pairs.at(pairId);
+            if (!pair.firstLotId.empty() && !pair.secondLotId.empty()) {
+                string lot = orderType == "buy" ? pair.secondLotId : pair.firstLotId;
+                double amount = orderType == "buy" ? order.quantity * order.price : order.quantity;
+                refunds.push_back(BalanceDelta{order.userId, lot, amount, -amount});
+            }
+
+            orderIds.push_back(orderId);
+            orders.push_back(order);
+            orderPairs.push_back(pairId);
+            orderTypes.push_back(orderType);
+        }
+
+        if (orderIds.empty()) {
+            return cancelled.dump();
+        }
+        if (!settleBalances(refunds)) {
+            throw runtime_error("Возврат средств привел бы к отрицательному балансу");
+        }
+
+        updateOrderRows(dbManager, orderIds, {"closed"}, {getCurrentTimestamp()});
+        for (size_t i = 0; i < orderIds.get_size(); i++) {
+            bookCancelOrder(orderIds[i]);
+            reportExecution(orders[i].userId, orderIds[i], orderPairs[i], orderTypes[i], status, orders[i].price, 0, 0, orders[i].quantity);
+            cancelled.push_back(orders[i].orderId);
+        }
+    }
+    catch (const exception& e) {
+        cerr << "[ERROR] Не удалось снять ордера: " << e.what() << endl;
+    }
+    return cancelled.dump();
+}
+
+string handleCancelAllOrders(DatabaseManager& dbManager, const string& userKey, const HashTable<string, string>& params) {
+    try {
+        cout << "[INFO] Пользователь " << userKey << " снимает все ордера" << endl;
+
+        if (userKey.empty()) {
+            return makeHttpResponse(401, R"({"error": "Нет заголовка X-USER-KEY"})");
+        }
+
+        string userId = getUserIdByKey(dbManager, *acquireSnapshot(), userKey);
+        if (userId.empty()) {
+            return makeHttpResponse(403, R"({"error": "Неверный ключ пользователя"})");
+        }
+
+        long long pairFilter = -1;
+        if (!parseIdParam(params, "pair_id", pairFilter)) {
+            return makeHttpResponse(400, R"({"error": "Параметр pair_id должен быть неотрицательным целым"})");
+        }
+
+        // Открытые заявки пользователя берутся из стакана и раскладываются по движкам их пар:
+        // каждый движок снимает свою часть одной командой
+        size_t shardCount = engineShardCount();
+        Vector<json> parts(shardCount);
+        for (size_t i = 0; i < shardCount; i++) {
+            parts[i] = {{"user_id", userId}, {"order_ids", json::array()}};
+        }
+
+        bookForEachOrder([&](const string& pairId, const string&, const BookOrder& order) {
+            if (order.userId != userId || (pairFilter >= 0 && pairId != to_string(pairFilter))) {
+                return;
+            }
+            parts[shardForPair(pairId)]["order_ids"].push_back(order.orderId);
+        });
+
+        Vector<future<string>> pending(shardCount);
+        for (size_t i = 0; i < shardCount; i++) {
+            if (!parts[i]["order_ids"].empty()) {
+                pending[i] = submitCommand(i, CommandType::CancelOrders, parts[i].dump(), userKey);
+            }
+        }
+
+        Vector<long long> cancelled;
+        for (size_t i = 0; i < shardCount; i++) {
+            if (!pending[i].valid()) {
+                continue;
+            }
+            json partCancelled = json::parse(pending[i].get());
+            for (const json& id : partCancelled) {
+                cancelled.push_back(id.get<long long>());
+            }
+        }
+
+        for (size_t i = 1; i < cancelled.get_size(); i++) {
+            for (size_t j = i; j > 0 && cancelled[j] < cancelled[j - 1]; j--) {
+                swap(cancelled[j], cancelled[j - 1]);
+            }
+        }
+
+        json response;
+        response["cancelled"] = json::array();
+        for (size_t i = 0; i < cancelled.get_size(); i++) {
+            response["cancelled"].push_back(cancelled[i]);
+        }
+        return makeHttpResponse(200, response.dump());
+
+    } catch (const exception& e) {
+        json error = {{"error", "Internal server error106"}, {"message", e.what()}};
+        return makeHttpResponse(500, error.dump());
+    }
+}
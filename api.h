@@ -2,22 +2,43 @@
 #define API_H
 
 #include <string>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include "structures.h"
+#include "snapshot.h"
+#include "httpstream.h"
 
 using namespace std;
 
-string handleGetBalance(DatabaseManager& dbManager, const string& userKey);
+string handleGetBalance(DatabaseManager& dbManager, const string& userKey, bool pretty = false, const string& ifNoneMatch = "");
 string getUserIdByKey(DatabaseManager& dbManager, const string& userKey);
+string getUserIdByKey(DatabaseManager& dbManager, const DatabaseSnapshot& snapshot, const string& userKey);
 string generateUserKey();
 string handleCreateUser(DatabaseManager& dbManager, const string& body);
-string handleGetLots(DatabaseManager& dbManager);
-string handleGetPairs(DatabaseManager& dbManager);
+shared_ptr<const string> handleGetLots(DatabaseManager& dbManager, bool pretty = false, const string& ifNoneMatch = "");
+shared_ptr<const string> handleGetPairs(DatabaseManager& dbManager, bool pretty = false, const string& ifNoneMatch = "");
 string handleCreateOrder(DatabaseManager&, const string& body, const string& userKey);
-string handleGetOrders(DatabaseManager& dbManager);
+string handleCreateOrderBatch(DatabaseManager& dbManager, const string& body, const string& userKey);
+string applyOrderBatch(DatabaseManager& dbManager, const string& body);
+string handleGetOrderBook(DatabaseManager& dbManager, const HashTable<string, string>& params, const string& ifNoneMatch = "");
+string handleGetMarketFeed(DatabaseManager& dbManager, const HashTable<string, string>& params);
+void handleMarketStream(DatabaseManager& dbManager, int clientSocket, const HashTable<string, string>& params, const string& lastEventId);
+string handleGetMyOrders(DatabaseManager& dbManager, const string& userKey, const HashTable<string, string>& params);
+string handleGetExecutions(DatabaseManager& dbManager, const string& userKey, const HashTable<string, string>& params);
+string handleGetEngineStats(DatabaseManager& dbManager, bool pretty = false);
+void handleGetOrders(DatabaseManager& dbManager, HttpStream& stream, const HashTable<string, string>& params, const string& ifNoneMatch = "");
+void handleGetTrades(DatabaseManager& dbManager, HttpStream& stream, const HashTable<string, string>& params, const string& ifNoneMatch = "");
 string handleDeleteOrder(DatabaseManager&, const string& body, const string& userKey);
-string makeHttpResponse(int statusCode, const string& body);
+string handleAmendOrder(DatabaseManager& dbManager, const string& body, const string& userKey);
+string handleCancelAllOrders(DatabaseManager& dbManager, const string& userKey, const HashTable<string, string>& params);
+string applyCancelOrders(DatabaseManager& dbManager, const string& body);
+string makeHttpResponse(int statusCode, const string& body, const string& extraHeaders = "");
 PairInfo getPairInfo(DatabaseManager& dbManager, const string& pairId);
-double getUserBalance(DatabaseManager& dbManager, const string& userId, const string& lotId);
+void publishTables(DatabaseManager& dbManager);
+shared_lock<shared_mutex> beginCommand();
+int updateOrderRows(DatabaseManager& dbManager, const Vector<string>& orderIds, const Vector<string>& columns, const Vector<string>& newValues);
+bool updateOrderRow(DatabaseManager& dbManager, const string& orderId, const Vector<string>& columns, const Vector<string>& newValues);
 bool updateOrderQuantity(DatabaseManager& dbManager, const string& orderId, double newQuantity);
 string getCurrentTimestamp();
 bool canDeleteOrder(DatabaseManager& dbManager, const string& orderId, const string& userId);
@@ -0,0 +1,226 @@
+#include "archive.h"
+#include "api.h"
+#include "auxiliary.h"
+#include "hashtable.h"
+#include "lockingtable.h"
+#include "orderindex.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static string archiveDate(long long closedAt) {
+    time_t t = closedAt;
+    tm parts;
+    gmtime_r(&t, &parts);
+    char buf[16];
+    strftime(buf, sizeof(buf), "%Y-%m-%d", &parts);
+    return buf;
+}
+
+// Дописывает строки в последний чанк раздела, новый чанк начинается по достижении tuples_limit
+static void appendToArchive(const DatabaseManager& dbManager, const string& date, const string& header, const Vector<string>& lines) {
+    string dir = dbManager.getSchemaName() + "/order_archive/" + date;
+    fs::create_directories(dir);
+
+    int chunk = 1;
+    while (fs::exists(dir + "/" + to_string(chunk + 1) + ".csv")) {
+        chunk++;
+    }
+
+    int rows = 0;
+    ifstream in(dir + "/" + to_string(chunk) + ".csv");
+    if (in.is_open()) {
+        string line;
+        getline(in, line);
+        while (getline(in, line)) {
+            rows++;
+        }
+        in.close();
+    }
+
+    ofstream out;
+    for (size_t i = 0; i < lines.get_size(); i++) {
+        if (!out.is_open() || rows >= dbManager.getTuplesLimit()) {
+            if (rows >= dbManager.getTuplesLimit()) {
+                out.close();
+                chunk++;
+                rows = 0;
+            }
+            string path = dir + "/" + to_string(chunk) + ".csv";
+            bool fresh = !fs::exists(path);
+            out.open(path, ios::app);
+            if (fresh) {
+                out << header << "\n";
+            }
+        }
+        out << lines[i] << "\n";
+        rows++;
+    }
+}
+
+// Строки сначала дописываются в архив и только потом удаляются из order:
+// сбой между этими шагами может лишь продублировать строку в архиве, но не потерять ее.
+size_t archiveClosedOrders(DatabaseManager& dbManager) {
+    size_t moved = 0;
+    {
+        TableLockGuard storageLock(dbManager, "order", LockMode::Exclusive, STORAGE_LOCK_TIMEOUT_MS);
+        const string schema = dbManager.getSchemaName();
+        // в каталоге архива лежит его файл блокировки, поэтому каталог нужен до первой дозаписи
+        fs::create_directories(schema + "/order_archive");
+        long long cutoff = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count() - ORDER_ARCHIVE_AGE_SEC;
+
+        for (int fileIndex = 1; ; fileIndex++) {
+            string csvPath = schema + "/order/" + to_string(fileIndex) + ".csv";
+            ifstream in(csvPath);
+            if (!in.is_open()) {
+                break;
+            }
+
+            string header;
+            getline(in, header);
+            int closedIdx = columnIndex(splitCSV(header), "closed");
+            int orderIdIdx = columnIndex(splitCSV(header), "order_id");
+
+            string content = header + "\n";
+            Vector<string> dates;
+            Vector<string> archivedIds;
+            HashTable<string, Vector<string>> archived;
+            string line;
+            while (getline(in, line)) {
+                if (line.empty()) {
+                    continue;
+                }
+                Vector<string> values = splitCSV(line);
+                string closed = closedIdx >= 0 && closedIdx < (int)values.get_size() ? values[closedIdx] : "";
+                if (closed.empty() || closed.find_first_not_of("0123456789") != string::npos || stoll(closed) > cutoff) {
+                    content += line + "\n";
+                    continue;
+                }
+
+                string date = archiveDate(stoll(closed));
+                if (!archived.contains(date)) {
+                    archived.insert(date, Vector<string>());
+                    dates.push_back(date);
+                }
+                archived.at(date).push_back(line);
+                if (orderIdIdx >= 0 && orderIdIdx < (int)values.get_size()) {
+                    archivedIds.push_back(values[orderIdIdx]);
+                }
+            }
+            in.close();
+
+            if (dates.empty()) {
+                continue;
+            }
+
+            {
+                TableLockGuard archiveLock(dbManager, "order_archive", LockMode::Exclusive, STORAGE_LOCK_TIMEOUT_MS);
+                for (size_t i = 0; i < dates.get_size(); i++) {
+                    appendToArchive(dbManager, dates[i], header, archived.at(dates[i]));
+                    moved += archived.at(dates[i]).get_size();
+                }
+            }
+
+            string tmpPath = csvPath + ".tmp";
+            ofstream out(tmpPath);
+            out << content;
+            out.close();
+            rename(tmpPath.c_str(), csvPath.c_str());
+            markChunkDirty("order", fileIndex);
+            indexRemoveOrders(archivedIds);
+            dbManager.bumpTableVersion("order");
+        }
+    }
+
+    if (moved > 0) {
+        publishTables(dbManager);
+    }
+    return moved;
+}
+
+static long long archivedOrderId(const Vector<string>& row) {
+    return stoll(row[0]);
+}
+
+// Оставляет в rows по одной строке на order_id в порядке возрастания, не больше limit строк (0 — все)
+static void compactArchivedRows(Vector<Vector<string>>& rows, size_t limit) {
+    sort(rows.begin(), rows.end(), [](const Vector<string>& a, const Vector<string>& b) {
+        return archivedOrderId(a) < archivedOrderId(b);
+    });
+    Vector<Vector<string>> unique;
+    for (size_t i = 0; i < rows.get_size() && (limit == 0 || unique.get_size() < limit); i++) {
+        if (unique.empty() || archivedOrderId(unique[unique.get_size() - 1]) != archivedOrderId(rows[i])) {
+            unique.push_back(rows[i]);
+        }
+    }
+    swap(rows, unique);
+}
+
+// Разделы лежат по датам закрытия, поэтому order_id в архиве идут не по порядку: подходящие строки
+// собираются и сортируются. При limit в памяти держится не больше 2 * limit строк
+Vector<Vector<string>> readArchivedOrders(DatabaseManager& dbManager, long long afterId, size_t limit, const function<bool(const Vector<string>& row)>& match) {
+    Vector<Vector<string>> rows;
+    string dir = dbManager.getSchemaName() + "/order_archive";
+    if (!fs::is_directory(dir)) {
+        return rows;
+    }
+
+    TableLockGuard archiveLock(dbManager, "order_archive", LockMode::Shared, STORAGE_LOCK_TIMEOUT_MS);
+    for (const auto& partition: fs::directory_iterator(dir)) {
+        if (!partition.is_directory()) {
+            continue;
+        }
+        for (int chunk = 1; ; chunk++) {
+            ifstream in(partition.path().string() + "/" + to_string(chunk) + ".csv");
+            if (!in.is_open()) {
+                break;
+            }
+
+            string line;
+            getline(in, line);
+            size_t columnCount = splitCSV(line).get_size();
+            while (getline(in, line)) {
+                Vector<string> row = splitCSV(line);
+                if (row.get_size() != columnCount || row[0].empty() || row[0].find_first_not_of("0123456789") != string::npos) {
+                    continue;
+                }
+                if (archivedOrderId(row) <= afterId || !match(row)) {
+                    continue;
+                }
+                rows.push_back(row);
+                if (limit > 0 && rows.get_size() >= 2 * limit) {
+                    compactArchivedRows(rows, limit);
+                }
+            }
+        }
+    }
+
+    compactArchivedRows(rows, limit);
+    return rows;
+}
+
+void startOrderArchiver(DatabaseManager& dbManager) {
+    thread([&dbManager]() {
+        while (true) {
+            this_thread::sleep_for(chrono::milliseconds(ORDER_ARCHIVE_INTERVAL_MS));
+            try {
+                size_t moved = archiveClosedOrders(dbManager);
+                if (moved > 0) {
+                    cout << "[INFO] В архив перенесено закрытых ордеров: " << moved << endl;
+                }
+            }
+            catch (const exception& e) {
+                cerr << "[ERROR] Архивация ордеров: " << e.what() << endl;
+            }
+        }
+    }).detach();
+}
@@ -0,0 +1,22 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <functional>
+#include "structures.h"
+
+using namespace std;
+
+// Закрытые заявки переносятся из order/N.csv в order_archive/ГГГГ-ММ-ДД/N.csv
+// (дата закрытия, UTC), чтобы сканы таблицы order проходили в основном по живым заявкам.
+const int ORDER_ARCHIVE_INTERVAL_MS = 10000;
+// Недавно закрытые заявки остаются в горячей таблице; перенесенные в архив GET /order и
+// GET /order/mine отдают по status=closed
+const long long ORDER_ARCHIVE_AGE_SEC = 60;
+
+size_t archiveClosedOrders(DatabaseManager& dbManager);
+// Строки архива (колонки как в чанках order) с order_id больше afterId, для которых match вернул true,
+// по возрастанию order_id и без повторов: сбой архиватора может продублировать строку. limit 0 — все
+Vector<Vector<string>> readArchivedOrders(DatabaseManager& dbManager, long long afterId, size_t limit, const function<bool(const Vector<string>& row)>& match);
+void startOrderArchiver(DatabaseManager& dbManager);
+
+#endif
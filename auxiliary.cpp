@@ -67,9 +67,10 @@ void writeTitle(const DatabaseManager& DBmanager, const string& tableName, const
         return;
     }
 
+    // Заголовок как у первого чанка (createCSV): первичный ключ, затем колонки
+    out << tableName << "_id";
     for (int i = 0; i < cols.get_size(); i++) {
-        if (i > 0) out << ",";
-        out << cols[i];
+        out << "," << cols[i];
     }
     out << "\n";
 }
@@ -127,4 +128,49 @@ json parseJsonBody(const string& body) {
 
 bool hasField(const json& j, const string& field) {
     return j.contains(field) && !j[field].is_null();
+}
+
+string urlDecode(const string& s) {
+    string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+') {
+            out += ' ';
+        }
+        else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2])) {
+            out += (char)stoi(s.substr(i + 1, 2), nullptr, 16);
+            i += 2;
+        }
+        else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+HashTable<string, string> parseQueryString(const string& query) {
+    HashTable<string, string> params;
+    stringstream ss(query);
+    string pair;
+
+    while (getline(ss, pair, '&')) {
+        if (pair.empty()) continue;
+
+        size_t eq = pair.find('=');
+        if (eq == string::npos) {
+            params.insert(urlDecode(pair), "");
+        }
+        else {
+            params.insert(urlDecode(pair.substr(0, eq)), urlDecode(pair.substr(eq + 1)));
+        }
+    }
+    return params;
+}
+
+bool queryFlag(const HashTable<string, string>& params, const string& name) {
+    if (!params.contains(name)) {
+        return false;
+    }
+    const string& value = params.at(name);
+    return value.empty() || value == "1" || value == "true";
 }
\ No newline at end of file
@@ -20,5 +20,8 @@ bool isColumnRef(const string& s);
 string escape(const string& s);
 json parseJsonBody(const string& body);
 bool hasField(const json& j, const string& field);
+string urlDecode(const string& s);
+HashTable<string, string> parseQueryString(const string& query);
+bool queryFlag(const HashTable<string, string>& params, const string& name);
 
 #endif
@@ -3,6 +3,7 @@
 #include "auxiliary.h"
 #include "Vector.h"
 #include "filter.h"
+#include "snapshot.h"
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -58,6 +59,7 @@ void deleteData(DatabaseManager& DBmanager, const string& tableName, const Vecto
         size_t colCount = headerCols.get_size();
 
         string line;
+        bool deletedInFile = false;
         while (getline(in, line)) {
             if (line.empty()) continue;
 
@@ -84,6 +86,7 @@ void deleteData(DatabaseManager& DBmanager, const string& tableName, const Vecto
             }
             else {
                 deletedAny = true;
+                deletedInFile = true;
             }
         }
 
@@ -92,6 +95,10 @@ void deleteData(DatabaseManager& DBmanager, const string& tableName, const Vecto
 
         remove(csvPath.c_str());
         rename(tmpPath.c_str(), csvPath.c_str());
+        if (deletedInFile) {
+            markChunkDirty(tableName, fileIndex);
+            DBmanager.bumpTableVersion(tableName);
+        }
 
         fileIndex++;
     }
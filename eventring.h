@@ -0,0 +1,61 @@
+#ifndef EVENTRING_H
+#define EVENTRING_H
+
+#include "Vector.h"
+
+using namespace std;
+
+// Последние capacity событий с последовательными номерами seq (начиная с 1).
+// T должен иметь поле seq. Синхронизацию обеспечивает владелец кольца.
+template<typename T>
+class EventRing {
+private:
+    Vector<T> events;
+    size_t capacity;
+    unsigned long long headSeq;
+
+public:
+    EventRing(size_t capacity = 1024) : capacity(capacity), headSeq(0) {}
+
+    unsigned long long push(T event) {
+        event.seq = ++headSeq;
+        if (events.get_size() < capacity) {
+            events.push_back(event);
+        }
+        else {
+            events[(event.seq - 1) % capacity] = event;
+        }
+        return event.seq;
+    }
+
+    unsigned long long head() const {
+        return headSeq;
+    }
+
+    // Добавляет в out события с номерами больше since, прошедшие filter, но не больше limit.
+    // lastSeq — номер, с которого продолжать следующее чтение.
+    // false, если часть событий после since уже вытеснена (или since из будущего).
+    template<typename Filter>
+    bool collect(unsigned long long since, size_t limit, Filter filter, Vector<T>& out, unsigned long long& lastSeq) const {
+        if (since > headSeq || since + events.get_size() < headSeq) {
+            lastSeq = headSeq;
+            return false;
+        }
+
+        for (unsigned long long seq = since + 1; seq <= headSeq; seq++) {
+            const T& event = events[(seq - 1) % capacity];
+            if (!filter(event)) {
+                continue;
+            }
+            out.push_back(event);
+            if (out.get_size() >= limit) {
+                lastSeq = seq;
+                return true;
+            }
+        }
+        lastSeq = headSeq;
+        return true;
+    }
+};
+
+#endif
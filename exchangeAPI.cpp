@@ -2,9 +2,11 @@
 #include "Vector.h"
 #include <iostream>
 #include <mutex>
-#include <sstream>
+#include <cstring>
+#include <strings.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <nlohmann/json.hpp>
 #include <arpa/inet.h>
 #include <unistd.h>
@@ -32,37 +34,216 @@ ExchangeAPI::ExchangeAPI() {
         host = "127.0.0.1";
     }
 
-    serverUrl = host + ":" + to_string(port);
+    serverHost = host;
+    serverPort = port;
 }
 
-string ExchangeAPI::sendRequest(
-    const string& method,
-    const string& endpoint,
-    const json& body,
-    const Vector<string>& headers
-) {
-    size_t pos = serverUrl.find(':');
-    string host = serverUrl.substr(0, pos);
-    int port = stoi(serverUrl.substr(pos + 1));
+ExchangeAPI::~ExchangeAPI() {
+    lock_guard<mutex> lock(poolMtx);
+    for (size_t i = 0; i < idleConnections.get_size(); i++) {
+        close(idleConnections[i]);
+    }
+}
 
+int ExchangeAPI::openConnection() {
     int sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0) throw runtime_error("socket error");
 
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    addr.sin_port = htons(serverPort);
+    inet_pton(AF_INET, serverHost.c_str(), &addr.sin_addr);
 
     if (connect(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
         close(sock);
         throw runtime_error("connect error");
     }
 
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return sock;
+}
+
+int ExchangeAPI::acquireConnection(bool& reused) {
+    {
+        lock_guard<mutex> lock(poolMtx);
+        if (!idleConnections.empty()) {
+            int sock = idleConnections[idleConnections.get_size() - 1];
+            idleConnections.pop_back();
+            reused = true;
+            return sock;
+        }
+    }
+    reused = false;
+    return openConnection();
+}
+
+void ExchangeAPI::releaseConnection(int sock) {
+    lock_guard<mutex> lock(poolMtx);
+    if (idleConnections.get_size() >= MAX_IDLE_CONNECTIONS) {
+        close(sock);
+        return;
+    }
+    idleConnections.push_back(sock);
+}
+
+static bool sendAllBytes(int sock, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+struct HttpResponse {
+    int status = 0;
+    bool keepAlive = true;
+    bool received = false;
+    string etag;
+    string body;
+};
+
+static bool recvMore(int sock, string& data, bool& received) {
+    char buf[4096];
+    ssize_t n = recv(sock, buf, sizeof(buf), 0);
+    if (n <= 0) {
+        return false;
+    }
+    data.append(buf, n);
+    received = true;
+    return true;
+}
+
+static bool headerNameIs(const string& data, size_t start, size_t colon, const char* name) {
+    size_t length = strlen(name);
+    if (colon - start != length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (tolower((unsigned char)data[start + i]) != name[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Разбирает ровно один ответ за один проход: строка статуса и заголовки читаются на месте,
+// тело собирается сразу в response.body по Content-Length или из chunked-потока.
+// Без этих заголовков тело длится до закрытия соединения.
+static bool readResponse(int sock, HttpResponse& response) {
+    string data;
+    size_t headersEnd;
+    while ((headersEnd = data.find("\r\n\r\n")) == string::npos) {
+        if (!recvMore(sock, data, response.received)) {
+            return false;
+        }
+    }
+
+    size_t lineEnd = data.find("\r\n");
+    size_t space = data.find(' ');
+    if (space == string::npos || space > lineEnd) {
+        return false;
+    }
+    response.status = atoi(data.c_str() + space + 1);
+
+    long long contentLength = -1;
+    bool chunked = false;
+    for (size_t pos = lineEnd + 2; pos < headersEnd; pos = lineEnd + 2) {
+        lineEnd = data.find("\r\n", pos);
+        size_t colon = data.find(':', pos);
+        if (colon == string::npos || colon > lineEnd) {
+            continue;
+        }
+        size_t valueStart = data.find_first_not_of(" \t", colon + 1);
+        if (valueStart > lineEnd) {
+            valueStart = lineEnd;
+        }
+        const char* value = data.c_str() + valueStart;
+        size_t valueLength = lineEnd - valueStart;
+
+        if (headerNameIs(data, pos, colon, "content-length")) {
+            contentLength = atoll(value);
+        }
+        else if (headerNameIs(data, pos, colon, "transfer-encoding")) {
+            chunked = valueLength >= 7 && strncasecmp(value, "chunked", 7) == 0;
+        }
+        else if (headerNameIs(data, pos, colon, "etag")) {
+            response.etag.assign(value, valueLength);
+        }
+        else if (headerNameIs(data, pos, colon, "connection")) {
+            response.keepAlive = !(valueLength == 5 && strncasecmp(value, "close", 5) == 0);
+        }
+    }
+    headersEnd += 4;
+
+    if (chunked) {
+        size_t pos = headersEnd;
+        while (true) {
+            while ((lineEnd = data.find("\r\n", pos)) == string::npos) {
+                if (!recvMore(sock, data, response.received)) {
+                    return false;
+                }
+            }
+            size_t chunkSize = strtoul(data.c_str() + pos, nullptr, 16);
+            pos = lineEnd + 2;
+            if (chunkSize == 0) {
+                // необязательные trailer-заголовки до пустой строки
+                while (true) {
+                    while ((lineEnd = data.find("\r\n", pos)) == string::npos) {
+                        if (!recvMore(sock, data, response.received)) {
+                            return false;
+                        }
+                    }
+                    bool last = lineEnd == pos;
+                    pos = lineEnd + 2;
+                    if (last) {
+                        return true;
+                    }
+                }
+            }
+            while (data.size() < pos + chunkSize + 2) {
+                if (!recvMore(sock, data, response.received)) {
+                    return false;
+                }
+            }
+            response.body.append(data, pos, chunkSize);
+            pos += chunkSize + 2;
+        }
+    }
+
+    response.body.assign(data, headersEnd, string::npos);
+    if (contentLength >= 0) {
+        while ((long long)response.body.size() < contentLength) {
+            if (!recvMore(sock, response.body, response.received)) {
+                return false;
+            }
+        }
+        response.body.resize(contentLength);
+        return true;
+    }
+
+    response.keepAlive = false;
+    while (recvMore(sock, response.body, response.received)) {
+    }
+    return true;
+}
+
+string ExchangeAPI::sendRequest(
+    const string& method,
+    const string& endpoint,
+    const json& body,
+    const Vector<string>& headers,
+    int* status,
+    string* etag
+) {
     string request =
         method + " " + endpoint + " HTTP/1.1\r\n"
-        "Host: " + host + "\r\n"
-        "Content-Type: application/json\r\n"
-        "Connection: close\r\n";
+        "Host: " + serverHost + "\r\n"
+        "Content-Type: application/json\r\n";
 
     for (size_t i = 0; i < headers.get_size(); ++i)
         request += headers[i] + "\r\n";
@@ -73,33 +254,42 @@ string ExchangeAPI::sendRequest(
 
     request += "\r\n" + bodyStr;
 
-    send(sock, request.c_str(), request.size(), 0);
-
-    string response;
-    char buf[4096];
-    ssize_t n;
-    while ((n = recv(sock, buf, sizeof(buf), 0)) > 0)
-        response.append(buf, n);
-
-    close(sock);
-
-    stringstream ss(response);
-    string statusLine;
-    getline(ss, statusLine);
-
-    int status;
-    string http;
-    stringstream(statusLine) >> http >> status;
+    // Сервер мог закрыть простаивавшее соединение: тогда запрос повторяется один раз по новому.
+    // Повтор безопасен, только если от сервера не пришло ни байта ответа.
+    HttpResponse response;
+    bool reused = false;
+    int sock = acquireConnection(reused);
+    while (true) {
+        bool ok = sendAllBytes(sock, request) && readResponse(sock, response);
+        if (ok) {
+            break;
+        }
+        close(sock);
+        if (!reused || response.received) {
+            throw runtime_error("[CLIENT] Соединение с сервером прервано");
+        }
+        sock = openConnection();
+        reused = false;
+    }
 
-    string line, bodyResp;
-    while (getline(ss, line) && line != "\r") {}
-    while (getline(ss, line)) bodyResp += line;
+    if (response.keepAlive) {
+        releaseConnection(sock);
+    }
+    else {
+        close(sock);
+    }
 
-    if (status >= 400) {
-        throw runtime_error("[CLIENT] API ошибка " + to_string(status));
+    if (response.status >= 400) {
+        throw runtime_error("[CLIENT] API ошибка " + to_string(response.status));
+    }
+    if (status != nullptr) {
+        *status = response.status;
+    }
+    if (etag != nullptr) {
+        *etag = response.etag;
     }
 
-    return bodyResp;
+    return move(response.body);
 }
 
 string ExchangeAPI::createUser(const string& username) {
@@ -118,14 +308,107 @@ void ExchangeAPI::setUserKey(const string& key) {
     userKey = key;
 }
 
+// Вызывается под referenceMtx. Возвращает true, если данные в кэше заменены новыми.
+bool ExchangeAPI::refreshReference(const string& endpoint, ReferenceCache& cache) {
+    auto now = chrono::steady_clock::now();
+    if (cache.loaded && now - cache.checkedAt < chrono::milliseconds(REFERENCE_REFRESH_MS)) {
+        return false;
+    }
+
+    Vector<string> headers;
+    if (cache.loaded && !cache.etag.empty()) {
+        headers.push_back("If-None-Match: " + cache.etag);
+    }
+
+    int status = 0;
+    string etag;
+    string response = sendRequest("GET", endpoint, json(), headers, &status, &etag);
+    cache.checkedAt = now;
+    if (status == 304) {
+        return false;
+    }
+
+    cache.data = json::parse(response);
+    cache.etag = etag;
+    cache.loaded = true;
+    return true;
+}
+
+// Блокировка не держится во время запроса, чтобы асинхронные запросы шли параллельно
+json ExchangeAPI::conditionalGet(const string& endpoint, const Vector<string>& headers) {
+    Vector<string> requestHeaders = headers;
+    {
+        lock_guard<mutex> lock(conditionalMtx);
+        if (conditionalCache.contains(endpoint)) {
+            requestHeaders.push_back("If-None-Match: " + conditionalCache.at(endpoint).etag);
+        }
+    }
+
+    int status = 0;
+    string etag;
+    string response = sendRequest("GET", endpoint, json(), requestHeaders, &status, &etag);
+
+    unique_lock<mutex> lock(conditionalMtx);
+    if (status == 304) {
+        if (conditionalCache.contains(endpoint)) {
+            return conditionalCache.at(endpoint).data;
+        }
+        // тела у 304 нет, а записи кэша уже нет: запрос повторяется без If-None-Match
+        lock.unlock();
+        response = sendRequest("GET", endpoint, json(), headers, &status, &etag);
+        lock.lock();
+    }
+
+    json data = json::parse(response);
+    if (!etag.empty()) {
+        ReferenceCache entry;
+        entry.data = data;
+        entry.etag = etag;
+        entry.loaded = true;
+        conditionalCache.insert(endpoint, entry);
+    }
+    return data;
+}
+
 json ExchangeAPI::getLots() {
-    string response = sendRequest("GET", "/lot");
-    return json::parse(response);
+    lock_guard<mutex> lock(referenceMtx);
+    if (refreshReference("/lot", lotsCache)) {
+        lotIdsByName.clear();
+        for (const auto& lot: lotsCache.data) {
+            lotIdsByName.insert(lot["name"].get<string>(), lot["lot_id"].get<int>());
+        }
+    }
+    return lotsCache.data;
 }
 
 json ExchangeAPI::getPairs() {
-    string response = sendRequest("GET", "/pair");
-    return json::parse(response);
+    lock_guard<mutex> lock(referenceMtx);
+    if (refreshReference("/pair", pairsCache)) {
+        lotsByPair.clear();
+        for (const auto& p: pairsCache.data) {
+            lotsByPair.insert(to_string(p["pair_id"].get<int>()), PairLots{p["sale_lot_id"].get<int>(), p["buy_lot_id"].get<int>()});
+        }
+    }
+    return pairsCache.data;
+}
+
+// -1, если лота с таким названием нет
+int ExchangeAPI::lotIdByName(const string& name) {
+    getLots();
+    lock_guard<mutex> lock(referenceMtx);
+    return lotIdsByName.contains(name) ? lotIdsByName.at(name) : -1;
+}
+
+bool ExchangeAPI::pairLots(int pairId, int& saleLotId, int& buyLotId) {
+    getPairs();
+    lock_guard<mutex> lock(referenceMtx);
+    string key = to_string(pairId);
+    if (!lotsByPair.contains(key)) {
+        return false;
+    }
+    saleLotId = lotsByPair.at(key).saleLotId;
+    buyLotId = lotsByPair.at(key).buyLotId;
+    return true;
 }
 
 json ExchangeAPI::getBalance() {
@@ -136,8 +419,7 @@ json ExchangeAPI::getBalance() {
     Vector<string> headerVector;
     headerVector.push_back("X-USER-KEY: " + userKey);
     
-    string response = sendRequest("GET", "/balance", json(), headerVector);
-    return json::parse(response);
+    return conditionalGet("/balance", headerVector);
 }
 
 json ExchangeAPI::getAllOrders() {
@@ -145,7 +427,30 @@ json ExchangeAPI::getAllOrders() {
     return json::parse(response);
 }
 
-int ExchangeAPI::createOrder(int pairId, double quantity, double price, const string& type) {
+json ExchangeAPI::getOrders(int pairId, const string& status, int limit, int afterId) {
+    string query;
+    if (pairId >= 0) {
+        query += "&pair_id=" + to_string(pairId);
+    }
+    if (!status.empty()) {
+        query += "&status=" + status;
+    }
+    if (limit > 0) {
+        query += "&limit=" + to_string(limit);
+    }
+    if (afterId > 0) {
+        query += "&after_id=" + to_string(afterId);
+    }
+    if (!query.empty()) {
+        query[0] = '?';
+    }
+
+    string response = sendRequest("GET", "/order" + query);
+    return json::parse(response);
+}
+
+// Возвращает order_id или -1, если заявка IOC/FOK снята, ничего не исполнив
+int ExchangeAPI::createOrder(int pairId, double quantity, double price, const string& type, const string& timeInForce, long long expireAt) {
     if (userKey.empty()) {
         throw runtime_error("[CLIENT] Не установлен ключ пользователя");
     }
@@ -155,6 +460,12 @@ int ExchangeAPI::createOrder(int pairId, double quantity, double price, const st
     request["quantity"] = quantity;
     request["price"] = price;
     request["type"] = type;
+    if (timeInForce != "GTC") {
+        request["time_in_force"] = timeInForce;
+    }
+    if (timeInForce == "GTT") {
+        request["expire_at"] = expireAt;
+    }
     
     Vector<string> headers;
     headers.push_back("X-USER-KEY: " + userKey);
@@ -162,6 +473,9 @@ int ExchangeAPI::createOrder(int pairId, double quantity, double price, const st
     try {
         string response = sendRequest("POST", "/order", request, headers);
         json result = json::parse(response);
+        if (result.value("status", "") == "killed") {
+            return -1;
+        }
         return result.at("order_id").get<int>();
     }
     catch (const json::out_of_range& exc) {
@@ -172,6 +486,30 @@ int ExchangeAPI::createOrder(int pairId, double quantity, double price, const st
     }
 }
 
+// Пачка заявок одним запросом: orders — массив объектов {pair_id, quantity, price, type}
+// и, при необходимости, time_in_force и expire_at.
+// Возвращает ответы по каждой заявке в том же порядке (order_id или error, и status).
+json ExchangeAPI::createOrders(const json& orders) {
+    if (userKey.empty()) {
+        throw runtime_error("[CLIENT] Не установлен ключ пользователя");
+    }
+    
+    Vector<string> headers;
+    headers.push_back("X-USER-KEY: " + userKey);
+    
+    try {
+        string response = sendRequest("POST", "/order/batch", orders, headers);
+        json result = json::parse(response);
+        return result.at("results");
+    }
+    catch (const json::out_of_range& exc) {
+        throw runtime_error("[CLIENT] Ошибка при создании пачки ордеров: ответ не содержит results");
+    }
+    catch (const json::exception& e) {
+        throw runtime_error("[CLIENT] Ошибка при создании пачки ордеров: " + string(e.what()));
+    }
+}
+
 bool ExchangeAPI::deleteOrder(int orderId) {
     if (userKey.empty()) {
         throw runtime_error("[CLIENT] Не установлен ключ пользователя");
@@ -193,19 +531,67 @@ bool ExchangeAPI::deleteOrder(int orderId) {
     }
 }
 
-double ExchangeAPI::getBalanceInRUB() {
-    json lots = getLots();
-    json balances = getBalance();
+// Меняет цену и объем открытого ордера; price или quantity, равные нулю, остаются прежними
+bool ExchangeAPI::amendOrder(int orderId, double price, double quantity) {
+    if (userKey.empty()) {
+        throw runtime_error("[CLIENT] Не установлен ключ пользователя");
+    }
     
-    int rubId = -1;
-    for (const auto& lot : lots) {
-        if (lot["name"] == "RUB") {
-            rubId = lot["lot_id"];
-            break;
-        }
+    json request;
+    request["order_id"] = orderId;
+    if (price > 0) {
+        request["price"] = price;
+    }
+    if (quantity > 0) {
+        request["quantity"] = quantity;
+    }
+    
+    Vector<string> headers;
+    headers.push_back("X-USER-KEY: " + userKey);
+    
+    try {
+        string response = sendRequest("PUT", "/order", request, headers);
+        json result = json::parse(response);
+        return result.contains("order_id");
+    } 
+    catch (const exception& e) {
+        return false;
+    }
+}
+
+// Снимает все открытые ордера пользователя (или только по паре pairId) и возвращает их id
+Vector<int> ExchangeAPI::cancelAllOrders(int pairId) {
+    if (userKey.empty()) {
+        throw runtime_error("[CLIENT] Не установлен ключ пользователя");
     }
     
+    Vector<string> headers;
+    headers.push_back("X-USER-KEY: " + userKey);
+    
+    string endpoint = "/order/all";
+    if (pairId != -1) {
+        endpoint += "?pair_id=" + to_string(pairId);
+    }
+    
+    try {
+        string response = sendRequest("DELETE", endpoint, json(), headers);
+        json result = json::parse(response);
+        Vector<int> cancelled;
+        for (const auto& id : result.at("cancelled")) {
+            cancelled.push_back(id.get<int>());
+        }
+        return cancelled;
+    }
+    catch (const json::exception& e) {
+        throw runtime_error("[CLIENT] Ошибка при снятии ордеров: " + string(e.what()));
+    }
+}
+
+double ExchangeAPI::getBalanceInRUB() {
+    int rubId = lotIdByName("RUB");
     if (rubId == -1) return 0.0;
+
+    json balances = getBalance();
     
     for (const auto& balance : balances) {
         if (balance["lot_id"] == rubId) {
@@ -217,27 +603,116 @@ double ExchangeAPI::getBalanceInRUB() {
 }
 
 json ExchangeAPI::getActiveOrder(int pairId) {
-    json allOrders = getAllOrders();
-    json result = json::array();
-    
-    for (const auto& order : allOrders) {
-        string closed = order["closed"];
-        bool isEmpty = true;
-        for (char c : closed) {
-            if (!isspace(static_cast<unsigned char>(c))) {
-                isEmpty = false;
+    return getOrders(pairId, "open");
+}
+
+// Собственные ордера пользователя; status — "open", "closed" или пустой (все)
+json ExchangeAPI::getMyOrders(int pairId, const string& status) {
+    if (userKey.empty()) {
+        throw runtime_error("[CLIENT] Не установлен ключ пользователя");
+    }
+
+    string query = "/order/mine";
+    string separator = "?";
+    if (pairId >= 0) {
+        query += separator + "pair_id=" + to_string(pairId);
+        separator = "&";
+    }
+    if (!status.empty()) {
+        query += separator + "status=" + status;
+    }
+
+    Vector<string> headers;
+    headers.push_back("X-USER-KEY: " + userKey);
+
+    string response = sendRequest("GET", query, json(), headers);
+    return json::parse(response);
+}
+
+json ExchangeAPI::getOrderBook(int pairId, int depth) {
+    string query = "/orderbook?depth=" + to_string(depth);
+    if (pairId >= 0) {
+        query += "&pair_id=" + to_string(pairId);
+    }
+
+    return conditionalGet(query);
+}
+
+json ExchangeAPI::getMarketFeed(int pairId, long long since, int timeoutMs) {
+    string query = "/feed?timeout=" + to_string(timeoutMs);
+    if (pairId >= 0) {
+        query += "&pair_id=" + to_string(pairId);
+    }
+    if (since >= 0) {
+        query += "&since=" + to_string(since);
+    }
+
+    string response = sendRequest("GET", query);
+    return json::parse(response);
+}
+
+json ExchangeAPI::getExecutions(long long since, int timeoutMs) {
+    if (userKey.empty()) {
+        throw runtime_error("[CLIENT] Не установлен ключ пользователя");
+    }
+
+    string query = "/execution?timeout=" + to_string(timeoutMs);
+    if (since >= 0) {
+        query += "&since=" + to_string(since);
+    }
+
+    Vector<string> headers;
+    headers.push_back("X-USER-KEY: " + userKey);
+
+    string response = sendRequest("GET", query, json(), headers);
+    return json::parse(response);
+}
+
+future<json> ExchangeAPI::getBalanceAsync() {
+    return async(launch::async, [this]() { return getBalance(); });
+}
+
+future<json> ExchangeAPI::getPairsAsync() {
+    return async(launch::async, [this]() { return getPairs(); });
+}
+
+future<json> ExchangeAPI::getActiveOrderAsync(int pairId) {
+    return async(launch::async, [this, pairId]() { return getActiveOrder(pairId); });
+}
+
+future<json> ExchangeAPI::getOrderBookAsync(int pairId, int depth) {
+    return async(launch::async, [this, pairId, depth]() { return getOrderBook(pairId, depth); });
+}
+
+future<json> ExchangeAPI::getExecutionsAsync(long long since) {
+    return async(launch::async, [this, since]() { return getExecutions(since); });
+}
+
+// Обновляет список открытых заявок по отчетам об исполнении.
+// Возвращает false при reset: часть отчетов потеряна, список нужно перечитать с сервера.
+bool applyExecutionReports(const json& feed, Vector<int>& openOrderIds) {
+    if (feed["reset"].get<bool>()) {
+        return false;
+    }
+
+    for (const auto& report: feed["reports"]) {
+        int orderId = report["order_id"];
+        string status = report["status"];
+        bool open = status == "accepted" || status == "amended" || (status == "partial" && report["remaining"].get<double>() > 0);
+
+        bool found = false;
+        for (size_t i = 0; i < openOrderIds.get_size(); i++) {
+            if (openOrderIds[i] == orderId) {
+                if (!open) {
+                    openOrderIds.erase(&openOrderIds[i]);
+                }
+                found = true;
                 break;
             }
         }
-        
-        if (!isEmpty) {
-            continue;
-        }
-        
-        if (pairId == -1 || order["pair_id"] == pairId) {
-            result.push_back(order);
+        if (open && !found) {
+            openOrderIds.push_back(orderId);
         }
     }
-    
-    return result;
-}
\ No newline at end of file
+    return true;
+}
@@ -2,32 +2,93 @@
 #define EXCHANGEAPI_H
 
 #include <nlohmann/json.hpp>
+#include <chrono>
+#include <future>
 #include <mutex>
 #include <string>
 #include "Vector.h"
+#include "hashtable.h"
 
 using json = nlohmann::json;
 using namespace std;
 
+// Сколько простаивающих соединений с сервером держит один клиент
+const size_t MAX_IDLE_CONNECTIONS = 8;
+// Как долго справочные данные (лоты, пары) берутся из кэша без сверки с сервером.
+// После этого кэш сверяется условным запросом: при совпадении ETag сервер отвечает 304 без тела.
+const int REFERENCE_REFRESH_MS = 5000;
+
+struct ReferenceCache {
+    json data;
+    string etag;
+    chrono::steady_clock::time_point checkedAt;
+    bool loaded = false;
+};
+
+struct PairLots {
+    int saleLotId;
+    int buyLotId;
+};
+
 class ExchangeAPI {
 private:
-    string serverUrl;
+    string serverHost;
+    int serverPort;
     string userKey;
     mutable mutex userkeyMtx;
-    string sendRequest(const string& method, const string& endpoint, const json& body = json(), const Vector<string>& headers = {});
+    // Пул постоянных соединений: запрос берет свободное соединение или открывает новое
+    Vector<int> idleConnections;
+    mutex poolMtx;
+    mutex referenceMtx;
+    ReferenceCache lotsCache;
+    ReferenceCache pairsCache;
+    HashTable<string, int> lotIdsByName;
+    HashTable<string, PairLots> lotsByPair;
+    // Последние ответы опрашиваемых запросов (баланс, стаканы): повтор идет с If-None-Match,
+    // и при 304 результат берется отсюда
+    mutex conditionalMtx;
+    HashTable<string, ReferenceCache> conditionalCache;
+
+    int openConnection();
+    int acquireConnection(bool& reused);
+    void releaseConnection(int sock);
+    string sendRequest(const string& method, const string& endpoint, const json& body = json(), const Vector<string>& headers = {}, int* status = nullptr, string* etag = nullptr);
+    bool refreshReference(const string& endpoint, ReferenceCache& cache);
+    json conditionalGet(const string& endpoint, const Vector<string>& headers = {});
 
 public:
     ExchangeAPI();
+    ~ExchangeAPI();
     string createUser(const string& username);
     void setUserKey(const string& key);
     json getLots();
     json getPairs();
+    int lotIdByName(const string& name);
+    bool pairLots(int pairId, int& saleLotId, int& buyLotId);
     json getBalance();
     json getAllOrders();
-    int createOrder(int pairId, double quantity, double price, const string& type);
+    json getOrders(int pairId = -1, const string& status = "", int limit = 0, int afterId = 0);
+    int createOrder(int pairId, double quantity, double price, const string& type, const string& timeInForce = "GTC", long long expireAt = 0);
+    json createOrders(const json& orders);
     bool deleteOrder(int orderId);
+    bool amendOrder(int orderId, double price, double quantity = 0);
+    Vector<int> cancelAllOrders(int pairId = -1);
     double getBalanceInRUB();
     json getActiveOrder(int pairId = -1);
+    json getMyOrders(int pairId = -1, const string& status = "");
+    json getOrderBook(int pairId = -1, int depth = 10);
+    json getMarketFeed(int pairId = -1, long long since = -1, int timeoutMs = 0);
+    json getExecutions(long long since = -1, int timeoutMs = 0);
+
+    // Асинхронные варианты: каждый запрос выполняется в своем потоке по соединению из пула,
+    // поэтому несколько запросов, запущенных подряд, занимают один сетевой круг, а не сумму
+    future<json> getBalanceAsync();
+    future<json> getPairsAsync();
+    future<json> getActiveOrderAsync(int pairId = -1);
+    future<json> getOrderBookAsync(int pairId = -1, int depth = 10);
+    future<json> getExecutionsAsync(long long since = -1);
 };
 
+bool applyExecutionReports(const json& feed, Vector<int>& openOrderIds);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "executions.h"
+#include "eventring.h"
+#include "hashtable.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+using namespace std;
+
+// У каждого пользователя своя нумерация отчетов
+static mutex executionsMtx;
+static condition_variable executionsCv;
+static HashTable<string, EventRing<ExecutionReport>> reportsByUser;
+
+void publishExecution(const string& userId, const ExecutionReport& report) {
+    {
+        lock_guard<mutex> lock(executionsMtx);
+        if (!reportsByUser.contains(userId)) {
+            reportsByUser.insert(userId, EventRing<ExecutionReport>(EXECUTION_REPORTS_PER_USER));
+        }
+        reportsByUser.at(userId).push(report);
+    }
+    executionsCv.notify_all();
+}
+
+unsigned long long executionSequence(const string& userId) {
+    lock_guard<mutex> lock(executionsMtx);
+    return reportsByUser.contains(userId) ? reportsByUser.at(userId).head() : 0;
+}
+
+// Отчеты пользователя с номерами больше since; если их нет, ждет до timeoutMs.
+// Возвращает false, если часть отчетов уже вытеснена: состояние заявок нужно перечитать через GET /order.
+bool readExecutions(const string& userId, unsigned long long since, size_t limit, int timeoutMs, Vector<ExecutionReport>& reports, unsigned long long& lastSeq) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    auto any = [](const ExecutionReport&) { return true; };
+    unique_lock<mutex> lock(executionsMtx);
+
+    while (true) {
+        if (reportsByUser.contains(userId)) {
+            if (!reportsByUser.at(userId).collect(since, limit, any, reports, lastSeq)) {
+                return false;
+            }
+        }
+        else if (since > 0) {
+            lastSeq = 0;
+            return false;
+        }
+        else {
+            lastSeq = 0;
+        }
+
+        if (!reports.empty()) {
+            return true;
+        }
+
+        since = lastSeq;
+        bool arrived = executionsCv.wait_until(lock, deadline, [&] {
+            return reportsByUser.contains(userId) && reportsByUser.at(userId).head() > since;
+        });
+        if (!arrived) {
+            return true;
+        }
+    }
+}
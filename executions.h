@@ -0,0 +1,33 @@
+#ifndef EXECUTIONS_H
+#define EXECUTIONS_H
+
+#include <string>
+#include "Vector.h"
+
+using namespace std;
+
+// Отчет об исполнении заявки для ее владельца.
+// status: accepted — заявка встала в стакан, partial — частичное исполнение,
+// filled — заявка исполнена полностью, cancelled — заявка снята, expired — снята по сроку (GTT),
+// amended — у заявки изменены цена или объем.
+// lastQuantity и lastPrice — объем и цена исполнения, remaining — остаток в стакане.
+struct ExecutionReport {
+    unsigned long long seq = 0;
+    long long orderId = 0;
+    string pairId;
+    string side;
+    string status;
+    double price = 0;
+    double lastQuantity = 0;
+    double lastPrice = 0;
+    double remaining = 0;
+};
+
+// Сколько последних отчетов хранится для каждого пользователя
+const size_t EXECUTION_REPORTS_PER_USER = 1024;
+
+void publishExecution(const string& userId, const ExecutionReport& report);
+bool readExecutions(const string& userId, unsigned long long since, size_t limit, int timeoutMs, Vector<ExecutionReport>& reports, unsigned long long& lastSeq);
+unsigned long long executionSequence(const string& userId);
+
+#endif
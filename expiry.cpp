@@ -0,0 +1,103 @@
+#include "expiry.h"
+#include "auxiliary.h"
+#include "orderbook.h"
+#include "sequencer.h"
+#include "snapshot.h"
+#include "timerwheel.h"
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+struct OrderExpiry {
+    string orderId;
+    string pairId;
+};
+
+static long long currentSecond() {
+    return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static mutex wheelMtx;
+static TimerWheel<OrderExpiry> wheel(currentSecond());
+
+void scheduleOrderExpiry(const string& orderId, const string& pairId, long long expireAt) {
+    lock_guard<mutex> lock(wheelMtx);
+    wheel.schedule(expireAt, OrderExpiry{orderId, pairId});
+}
+
+// Сроки ставятся только открытым заявкам: строки снятых и исполненных заявок пропускаются
+void loadOrderExpiries(const DatabaseManager& dbManager) {
+    int orderIdIdx = rowColumnIndex(dbManager, "order_expiry", "order_id");
+    int expireAtIdx = rowColumnIndex(dbManager, "order_expiry", "expire_at");
+    shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
+    Vector<Condition> cond;
+    size_t scheduled = 0;
+
+    scanSnapshot(dbManager, *snapshot, "order_expiry", cond, [&](const Vector<string>& row) {
+        BookOrder order;
+        string pairId, type;
+        if (!bookFindOrder(row[orderIdIdx], order, pairId, type)) {
+            return;
+        }
+        scheduleOrderExpiry(row[orderIdIdx], pairId, stoll(row[expireAtIdx]));
+        scheduled++;
+    });
+
+    if (scheduled > 0) {
+        cout << "[INFO] Заявок GTT со сроком: " << scheduled << endl;
+    }
+}
+
+// Истекшие заявки снимает движок их пары той же командой, что и массовую отмену
+static void expireOrders(const Vector<OrderExpiry>& due) {
+    size_t shardCount = engineShardCount();
+    Vector<json> parts(shardCount);
+    for (size_t i = 0; i < shardCount; i++) {
+        parts[i] = {{"status", "expired"}, {"order_ids", json::array()}};
+    }
+    for (size_t i = 0; i < due.get_size(); i++) {
+        parts[shardForPair(due[i].pairId)]["order_ids"].push_back(stoll(due[i].orderId));
+    }
+
+    Vector<future<string>> pending(shardCount);
+    for (size_t i = 0; i < shardCount; i++) {
+        if (!parts[i]["order_ids"].empty()) {
+            pending[i] = submitCommand(i, CommandType::CancelOrders, parts[i].dump(), "");
+        }
+    }
+
+    size_t expired = 0;
+    for (size_t i = 0; i < shardCount; i++) {
+        if (pending[i].valid()) {
+            expired += json::parse(pending[i].get()).size();
+        }
+    }
+    if (expired > 0) {
+        cout << "[INFO] Снято заявок GTT по сроку: " << expired << endl;
+    }
+}
+
+void startOrderExpiry() {
+    thread([]() {
+        while (true) {
+            this_thread::sleep_for(chrono::milliseconds(ORDER_EXPIRY_TICK_MS));
+            Vector<OrderExpiry> due;
+            {
+                lock_guard<mutex> lock(wheelMtx);
+                wheel.advance(currentSecond(), due);
+            }
+            if (due.empty()) {
+                continue;
+            }
+            try {
+                expireOrders(due);
+            }
+            catch (const exception& e) {
+                cerr << "[ERROR] Снятие заявок по сроку: " << e.what() << endl;
+            }
+        }
+    }).detach();
+}
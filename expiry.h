@@ -0,0 +1,17 @@
+#ifndef EXPIRY_H
+#define EXPIRY_H
+
+#include <string>
+#include "structures.h"
+
+using namespace std;
+
+// Заявки GTT снимаются с рынка в момент expire_at (секунды Unix). Сроки хранятся в колесе таймеров
+// и в таблице order_expiry, по которой колесо восстанавливается после перезапуска.
+const int ORDER_EXPIRY_TICK_MS = 200;
+
+void scheduleOrderExpiry(const string& orderId, const string& pairId, long long expireAt);
+void loadOrderExpiries(const DatabaseManager& dbManager);
+void startOrderExpiry();
+
+#endif
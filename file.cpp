@@ -33,6 +33,14 @@ void loadSchema(DatabaseManager& DBmanager) {
         DBmanager.addTable(tempTable);
     }
 
+    // Журнал сделок и сроки заявок GTT ведутся сервером, даже если их нет в schema.json
+    if (!DBmanager.getTables().contains("trade")) {
+        DBmanager.addTable(DBtable("trade", {"pair_id", "buy_order_id", "sell_order_id", "price", "quantity", "timestamp"}));
+    }
+    if (!DBmanager.getTables().contains("order_expiry")) {
+        DBmanager.addTable(DBtable("order_expiry", {"order_id", "expire_at"}));
+    }
+
     DBmanager.setSchemaName(schema["name"]);
     DBmanager.setTuplesLimit(schema["tuples_limit"]);
 }
@@ -148,14 +156,14 @@ void createFileStruct(const DatabaseManager& DBmanager) {
 
             string tableDirectory = DBmanager.getSchemaName() + "/" + table.getName();
 
+            // Существующие таблицы не трогаем: в старую базу добавляются только новые
             if (!fs::exists(tableDirectory)) {
                 fs::create_directories(tableDirectory);
+                createCSV(tableDirectory, table);
+                createPkFile(tableDirectory, table.getName());
+                createLockFile(tableDirectory, table.getName());
             }
 
-            createCSV(tableDirectory, table);
-            createPkFile(tableDirectory, table.getName());
-            createLockFile(tableDirectory, table.getName());
-
             node = node->getNext();
         }
     }
@@ -167,6 +175,9 @@ void initCryptoDatabase(DatabaseManager& DBmanager) {
         createFileStruct(DBmanager);  
         loadLotsFromConfig(DBmanager);  
         generatePairs(DBmanager);   
-    }     
+    }
+    else {
+        createFileStruct(DBmanager);
+    }
     cout << "Структура биржи инициализирована.\n";
 }
\ No newline at end of file
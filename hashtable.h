@@ -199,6 +199,19 @@ public:
         throw out_of_range("Ключ не найден");
     }
 
+    bool contains(const K& key) const {
+        size_t index = hf(key, capacity);
+        Node<K,V>* current = table[index];
+
+        while (current != nullptr) {
+            if (current->key == key) {
+                return true;
+            }
+            current = current->next;
+        }
+        return false;
+    }
+
     void erase(const K& key) {
         size_t index = hf(key, capacity);
         Node<K,V>* nodeToDelete = table[index];
@@ -222,6 +235,20 @@ public:
         }
     }
 
+    // Удаляет все элементы, вместимость сохраняется
+    void clear() {
+        for (size_t i = 0; i < capacity; ++i) {
+            Node<K,V>* current = table[i];
+            while (current != nullptr) {
+                Node<K,V>* temp = current;
+                current = current->next;
+                delete temp;
+            }
+            table[i] = nullptr;
+        }
+        size = 0;
+    }
+
     size_t getSize() const {
         return size;
     }
@@ -0,0 +1,126 @@
+#include "httpstream.h"
+#include <sys/socket.h>
+#include <cstdio>
+
+using namespace std;
+
+string httpStatusText(int statusCode) {
+    switch (statusCode) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 409: return "Conflict";
+        case 500: return "Internal Server Error";
+        default: return "Unknown";
+    }
+}
+
+bool sendAll(int socket, const char* data, size_t size) {
+    size_t totalSent = 0;
+    while (totalSent < size) {
+        ssize_t sent = send(socket, data + totalSent, size - totalSent, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        totalSent += sent;
+    }
+    return true;
+}
+
+string notModifiedResponse(const string& etag) {
+    return "HTTP/1.1 304 Not Modified\r\nETag: " + etag + "\r\nContent-Length: 0\r\n\r\n";
+}
+
+HttpStream::HttpStream(int socket, int statusCode, size_t flushThreshold)
+    : socket(socket), statusCode(statusCode), flushThreshold(flushThreshold), headersSent(false), failed(false) {}
+
+string& HttpStream::body() {
+    return buffer;
+}
+
+// Дополнительный заголовок ответа; действует, только пока заголовки еще не отправлены
+void HttpStream::addHeader(const string& name, const string& value) {
+    extraHeaders += name + ": " + value + "\r\n";
+}
+
+void HttpStream::notModified(const string& etag) {
+    string response = notModifiedResponse(etag);
+    headersSent = true;
+    failed = !sendAll(socket, response.data(), response.size());
+}
+
+void HttpStream::sendHeaders() {
+    string headers = "HTTP/1.1 " + to_string(statusCode) + " " + httpStatusText(statusCode) + "\r\n" + "Content-Type: application/json\r\n" + extraHeaders + "Transfer-Encoding: chunked\r\n" + "\r\n";
+    headersSent = true;
+    if (!sendAll(socket, headers.data(), headers.size())) {
+        failed = true;
+    }
+}
+
+void HttpStream::flushIfNeeded() {
+    if (buffer.size() >= flushThreshold) {
+        flush();
+    }
+}
+
+void HttpStream::flush() {
+    if (failed || buffer.empty()) {
+        buffer.clear();
+        return;
+    }
+    if (!headersSent) {
+        sendHeaders();
+    }
+
+    char sizeLine[20];
+    int len = snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", buffer.size());
+    buffer += "\r\n";
+
+    if (!sendAll(socket, sizeLine, len) || !sendAll(socket, buffer.data(), buffer.size())) {
+        failed = true;
+    }
+    buffer.clear();
+}
+
+bool HttpStream::finish() {
+    if (failed) {
+        return false;
+    }
+
+    if (!headersSent) {
+        string response = "HTTP/1.1 " + to_string(statusCode) + " " + httpStatusText(statusCode) + "\r\n" + "Content-Type: application/json\r\n" + extraHeaders + "Content-Length: " + to_string(buffer.size()) + "\r\n" + "\r\n" + buffer;
+        buffer.clear();
+        failed = !sendAll(socket, response.data(), response.size());
+        return !failed;
+    }
+
+    flush();
+    if (!failed && !sendAll(socket, "0\r\n\r\n", 5)) {
+        failed = true;
+    }
+    return !failed;
+}
+
+void HttpStream::fail(int errorStatus, const string& errorBody) {
+    if (headersSent) {
+        // статус уже ушел клиенту: оборванный chunked-поток он распознает сам
+        failed = true;
+        return;
+    }
+    statusCode = errorStatus;
+    buffer = errorBody;
+    extraHeaders.clear();
+    finish();
+}
+
+bool HttpStream::headersWereSent() const {
+    return headersSent;
+}
+
+bool HttpStream::ok() const {
+    return !failed;
+}
@@ -0,0 +1,41 @@
+#ifndef HTTPSTREAM_H
+#define HTTPSTREAM_H
+
+#include <string>
+
+using namespace std;
+
+string httpStatusText(int statusCode);
+bool sendAll(int socket, const char* data, size_t size);
+string notModifiedResponse(const string& etag);
+
+// Ответ, который отправляется клиенту по мере формирования (Transfer-Encoding: chunked).
+// Пока буфер не превысил порог, заголовки не отправлены, и короткий ответ уходит целиком с Content-Length.
+class HttpStream {
+private:
+    int socket;
+    int statusCode;
+    size_t flushThreshold;
+    bool headersSent;
+    bool failed;
+    string buffer;
+    string extraHeaders;
+
+    void sendHeaders();
+
+public:
+    HttpStream(int socket, int statusCode = 200, size_t flushThreshold = 16 * 1024);
+
+    string& body();
+    void addHeader(const string& name, const string& value);
+    void notModified(const string& etag);
+    void flushIfNeeded();
+    void flush();
+    bool finish();
+    void fail(int errorStatus, const string& errorBody);
+
+    bool headersWereSent() const;
+    bool ok() const;
+};
+
+#endif
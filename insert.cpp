@@ -2,6 +2,7 @@
 #include "Vector.h"
 #include "insert.h"
 #include "auxiliary.h"
+#include "snapshot.h"
 #include <iostream>
 #include <fstream>
 
@@ -14,50 +15,38 @@ void insertData(DatabaseManager& DBmanager, const string& table, const string& q
     string schemaDir = DBmanager.getSchemaName();
     const int limit = DBmanager.getTuplesLimit();
 
+    // Новые строки дописываются только в последний чанк: после удаления строк из ранних
+    // чанков (архивация, контрольная точка счетов) порядок ключей по чанкам не нарушается
     int num = 1;
-    string csvPath;
-    bool needNewCSV = false;
-
-    while (true) {
-        csvPath = schemaDir + "/" + table + "/" + to_string(num) + ".csv";
-        
-        ifstream in(csvPath);
-        if (!in.is_open()) {
-            needNewCSV = true;
-            break;
-        }
+    while (ifstream(schemaDir + "/" + table + "/" + to_string(num + 1) + ".csv").good()) {
+        num++;
+    }
 
-        string header;
-        getline(in, header);
-        if (header.empty()) {
-            needNewCSV = true;
-            break;
-        }
+    string csvPath = schemaDir + "/" + table + "/" + to_string(num) + ".csv";
+    bool needNewCSV = false;
 
+    ifstream in(csvPath);
+    string header;
+    if (!in.is_open() || !getline(in, header) || header.empty()) {
+        needNewCSV = true;
+    }
+    else {
         int rows = 0;
         string line;
         while (getline(in, line)) {
             rows++;
         }
-        in.close();
-
-        if (rows < limit) {
-            break;
+        if (rows >= limit) {
+            num++;
+            csvPath = schemaDir + "/" + table + "/" + to_string(num) + ".csv";
+            needNewCSV = true;
         }
-
-        num++;
     }
+    in.close();
 
     if (needNewCSV) {
         writeTitle(DBmanager, table, csvPath);
     }
-    else {
-        ifstream in(csvPath);
-        if (in.peek() == ifstream::traits_type::eof()) {
-            writeTitle(DBmanager, table, csvPath);
-        }
-        in.close();
-    }
 
     Vector<string> values = parseValues(query);
     Vector<string> columns = tbl.accessColumns();
@@ -89,6 +78,8 @@ void insertData(DatabaseManager& DBmanager, const string& table, const string& q
 
     out << "\n";
     out.close();
+    markChunkDirty(table, num);
+    DBmanager.bumpTableVersion(table);
 
     pk++;
 
@@ -269,7 +269,7 @@ void executeSelect(DatabaseManager& dbManager, const string& command) {
     Vector<string> lockedTables;
 
     for (size_t i = 0; i < tableNames.get_size(); i++) {
-        if (!lockTable(dbManager, tableNames[i])) {
+        if (!lockTable(dbManager, tableNames[i], LockMode::Shared)) {
             cout << "Ошибка: таблица заблокирована: " << tableNames[i] << "\n";
 
             for (size_t j = 0; j < lockedTables.get_size(); j++) {
@@ -356,6 +356,20 @@ void executeDelete(DatabaseManager& dbManager, const string& command) {
     unlockTable(dbManager, tableName);
 }
 
+void executeLockStats(DatabaseManager& dbManager) {
+    const auto& tableHash = dbManager.getTables();
+
+    for (size_t i = 0; i < tableHash.getCapacity(); i++) {
+        Node<string, DBtable>* node = tableHash.getChain(i);
+
+        while (node != nullptr) {
+            LockStats stats = getLockStats(node->getKey());
+            cout << node->getKey() << ": захватов " << stats.acquired << ", ожиданий " << stats.waits << ", таймаутов " << stats.timeouts << ", ожидание " << stats.waitMicros << " мкс\n";
+            node = node->getNext();
+        }
+    }
+}
+
 string processCommand(DatabaseManager& dbManager, const string& command) {
     stringstream output;
 
@@ -386,6 +400,9 @@ string processCommand(DatabaseManager& dbManager, const string& command) {
         else if (upperCmd == "DELETE") {
             executeDelete(dbManager, command);
         }
+        else if (upperCmd == "LOCKS") {
+            executeLockStats(dbManager);
+        }
         else if (upperCmd == "EXIT" || upperCmd == "QUIT") {
             cout.rdbuf(oldCoutBuffer);
             return "EXIT";
@@ -0,0 +1,142 @@
+#include "jsonwriter.h"
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+
+JsonWriter::JsonWriter(string& out, bool pretty) : out(out), pretty(pretty), afterKey(false) {}
+
+void JsonWriter::newline() {
+    out += '\n';
+    out.append(firstInScope.get_size() * 4, ' ');
+}
+
+void JsonWriter::beforeValue() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (firstInScope.empty()) {
+        return;
+    }
+
+    bool& first = firstInScope[firstInScope.get_size() - 1];
+    if (!first) {
+        out += ',';
+    }
+    first = false;
+
+    if (pretty) {
+        newline();
+    }
+}
+
+void JsonWriter::writeEscaped(const string& s) {
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+                    out += buf;
+                }
+                else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+void JsonWriter::beginArray() {
+    beforeValue();
+    out += '[';
+    firstInScope.push_back(true);
+}
+
+void JsonWriter::endArray() {
+    bool empty = firstInScope[firstInScope.get_size() - 1];
+    firstInScope.pop_back();
+    if (pretty && !empty) {
+        newline();
+    }
+    out += ']';
+}
+
+void JsonWriter::beginObject() {
+    beforeValue();
+    out += '{';
+    firstInScope.push_back(true);
+}
+
+void JsonWriter::endObject() {
+    bool empty = firstInScope[firstInScope.get_size() - 1];
+    firstInScope.pop_back();
+    if (pretty && !empty) {
+        newline();
+    }
+    out += '}';
+}
+
+void JsonWriter::key(const string& k) {
+    beforeValue();
+    writeEscaped(k);
+    out += pretty ? ": " : ":";
+    afterKey = true;
+}
+
+void JsonWriter::value(const string& s) {
+    beforeValue();
+    writeEscaped(s);
+}
+
+void JsonWriter::value(const char* s) {
+    value(string(s));
+}
+
+void JsonWriter::value(long long n) {
+    beforeValue();
+    char buf[24];
+    auto res = to_chars(buf, buf + sizeof(buf), n);
+    out.append(buf, res.ptr);
+}
+
+void JsonWriter::value(int n) {
+    value(static_cast<long long>(n));
+}
+
+void JsonWriter::value(double d) {
+    if (!isfinite(d)) {
+        null();
+        return;
+    }
+
+    beforeValue();
+    char buf[32];
+    auto res = to_chars(buf, buf + sizeof(buf), d);
+    string_view text(buf, res.ptr - buf);
+    out.append(text);
+    // как и nlohmann::json, целое значение double пишем с дробной частью
+    if (text.find_first_of(".eE") == string_view::npos) {
+        out += ".0";
+    }
+}
+
+void JsonWriter::value(bool b) {
+    beforeValue();
+    out += b ? "true" : "false";
+}
+
+void JsonWriter::null() {
+    beforeValue();
+    out += "null";
+}
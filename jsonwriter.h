@@ -0,0 +1,39 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <string>
+#include "Vector.h"
+
+using namespace std;
+
+// Потоковая запись JSON прямо в буфер ответа, без построения дерева nlohmann::json.
+class JsonWriter {
+private:
+    string& out;
+    bool pretty;
+    Vector<bool> firstInScope;
+    bool afterKey;
+
+    void beforeValue();
+    void newline();
+    void writeEscaped(const string& s);
+
+public:
+    JsonWriter(string& out, bool pretty = false);
+
+    void beginArray();
+    void endArray();
+    void beginObject();
+    void endObject();
+
+    void key(const string& k);
+    void value(const string& s);
+    void value(const char* s);
+    void value(long long n);
+    void value(int n);
+    void value(double d);
+    void value(bool b);
+    void null();
+};
+
+#endif
@@ -1,46 +1,185 @@
 #include <iostream>
-#include <fstream>
 #include <string>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
 #include "structures.h"
+#include "hashtable.h"
 #include "lockingtable.h"
 
 using namespace std;
 
-bool lockTable(const DatabaseManager& DBmanager, const string& tableName) {
+struct TableLock {
+    mutex mtx;
+    condition_variable cv;
+    int readers = 0;
+    bool writer = false;
+    int waitingWriters = 0;
+    // первый держатель берет flock без мьютекса; пока он это делает, новые читатели ждут
+    bool acquiringFile = false;
+    LockStats stats;
+};
+
+static mutex registryMtx;
+static HashTable<string, TableLock*> tableLocks;
+static atomic<bool> fileLocking(true);
+
+static TableLock* getTableLock(const string& tableName) {
+    lock_guard<mutex> lock(registryMtx);
+    if (!tableLocks.contains(tableName)) {
+        tableLocks.insert(tableName, new TableLock());
+    }
+    return tableLocks.at(tableName);
+}
+
+static int lockFileFD(DatabaseManager& DBmanager, const string& tableName) {
+    lock_guard<mutex> lock(registryMtx);
+    HashTable<string, int>& fds = DBmanager.getLockFDs();
+    if (fds.contains(tableName)) {
+        return fds.at(tableName);
+    }
+
     string path = DBmanager.getSchemaName() + "/" + tableName + "/" + tableName + "_lock";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd >= 0) {
+        fds.insert(tableName, fd);
+    }
+    return fd;
+}
 
-    ifstream in(path);
-    if (!in.is_open()) {
-        return false;
+static bool acquireFileLock(int fd, LockMode mode, chrono::steady_clock::time_point deadline) {
+    int op = (mode == LockMode::Shared ? LOCK_SH : LOCK_EX) | LOCK_NB;
+    while (flock(fd, op) != 0) {
+        if (errno != EWOULDBLOCK && errno != EINTR) {
+            return false;
+        }
+        if (chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
     }
+    return true;
+}
 
-    string state;
-    in >> state;
-    in.close();
+bool lockTable(DatabaseManager& DBmanager, const string& tableName, LockMode mode, int timeoutMs) {
+    TableLock* tl = getTableLock(tableName);
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::milliseconds(timeoutMs);
 
-    if (state == "locked") {
-        return false;
+    unique_lock<mutex> lock(tl->mtx);
+    bool waited = false;
+    bool granted = true;
+
+    if (mode == LockMode::Exclusive) {
+        auto ready = [tl]() { return !tl->writer && tl->readers == 0; };
+        if (!ready()) {
+            waited = true;
+            tl->waitingWriters++;
+            granted = tl->cv.wait_until(lock, deadline, ready);
+            tl->waitingWriters--;
+        }
+        if (granted) {
+            tl->writer = true;
+        }
+    }
+    else {
+        // пока ждет писатель, новые читатели не проходят, иначе он может не дождаться
+        auto ready = [tl]() { return !tl->writer && tl->waitingWriters == 0 && !tl->acquiringFile; };
+        if (!ready()) {
+            waited = true;
+            granted = tl->cv.wait_until(lock, deadline, ready);
+        }
+        if (granted) {
+            tl->readers++;
+        }
+    }
+
+    bool firstHolder = mode == LockMode::Exclusive || tl->readers == 1;
+    if (granted && fileLocking.load() && firstHolder) {
+        // ожидание flock может длиться до deadline: мьютекс на это время отпускается,
+        // чтобы unlockTable и другие ожидающие этой таблицы не стояли на нем
+        tl->acquiringFile = true;
+        lock.unlock();
+        int fd = lockFileFD(DBmanager, tableName);
+        bool fileLocked = fd >= 0 && acquireFileLock(fd, mode, deadline);
+        lock.lock();
+        tl->acquiringFile = false;
+        tl->cv.notify_all();
+        if (!fileLocked) {
+            granted = false;
+            if (mode == LockMode::Exclusive) {
+                tl->writer = false;
+            }
+            else {
+                tl->readers--;
+            }
+        }
     }
 
-    ofstream out(path);
-    if (!out.is_open()) {
+    if (waited) {
+        tl->stats.waits++;
+        tl->stats.waitMicros += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    if (!granted) {
+        tl->stats.timeouts++;
+        tl->cv.notify_all();
         return false;
     }
 
-    out << "locked";
-    out.close();
+    tl->stats.acquired++;
     return true;
 }
 
-void unlockTable(const DatabaseManager& DBmanager, const string& tableName) {
-    string path = DBmanager.getSchemaName() + "/" + tableName + "/" + tableName + "_lock";
+void unlockTable(DatabaseManager& DBmanager, const string& tableName) {
+    TableLock* tl = getTableLock(tableName);
+    lock_guard<mutex> lock(tl->mtx);
 
-    ofstream out(path);
-    if (!out.is_open()) {
+    if (tl->writer) {
+        tl->writer = false;
+    }
+    else if (tl->readers > 0) {
+        tl->readers--;
+    }
+    else {
         cout << "Ошибка при разблокировке.\n";
         return;
     }
 
-    out << "unlocked";
-    out.close();
-}
\ No newline at end of file
+    if (fileLocking.load() && !tl->writer && tl->readers == 0) {
+        int fd = lockFileFD(DBmanager, tableName);
+        if (fd >= 0) {
+            flock(fd, LOCK_UN);
+        }
+    }
+
+    tl->cv.notify_all();
+}
+
+void setFileLocking(bool enabled) {
+    fileLocking.store(enabled);
+}
+
+TableLockGuard::TableLockGuard(DatabaseManager& DBmanager, const string& tableName, LockMode mode, int timeoutMs)
+    : DBmanager(DBmanager), tableName(tableName) {
+    if (!lockTable(DBmanager, tableName, mode, timeoutMs)) {
+        throw runtime_error("Таблица заблокирована: " + tableName);
+    }
+}
+
+TableLockGuard::~TableLockGuard() {
+    unlockTable(DBmanager, tableName);
+}
+
+LockStats getLockStats(const string& tableName) {
+    TableLock* tl = getTableLock(tableName);
+    lock_guard<mutex> lock(tl->mtx);
+    return tl->stats;
+}
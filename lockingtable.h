@@ -6,7 +6,39 @@
 
 using namespace std;
 
-bool lockTable(const DatabaseManager& DBmanager, const string& tableName);
-void unlockTable(const DatabaseManager& DBmanager, const string& tableName);
+enum class LockMode {
+    Shared,
+    Exclusive
+};
 
-#endif
\ No newline at end of file
+struct LockStats {
+    unsigned long acquired = 0;
+    unsigned long waits = 0;
+    unsigned long timeouts = 0;
+    unsigned long long waitMicros = 0;
+};
+
+const int DEFAULT_LOCK_TIMEOUT_MS = 1000;
+// записи сервера ждут дольше: таблицу order может держать архиватор на весь проход по чанкам
+const int STORAGE_LOCK_TIMEOUT_MS = 30000;
+
+bool lockTable(DatabaseManager& DBmanager, const string& tableName, LockMode mode = LockMode::Exclusive, int timeoutMs = DEFAULT_LOCK_TIMEOUT_MS);
+void unlockTable(DatabaseManager& DBmanager, const string& tableName);
+void setFileLocking(bool enabled);
+LockStats getLockStats(const string& tableName);
+
+// Держит блокировку таблицы до конца области видимости. Если взять ее за timeoutMs не удалось, бросает runtime_error
+class TableLockGuard {
+private:
+    DatabaseManager& DBmanager;
+    string tableName;
+
+public:
+    TableLockGuard(DatabaseManager& DBmanager, const string& tableName, LockMode mode = LockMode::Exclusive, int timeoutMs = DEFAULT_LOCK_TIMEOUT_MS);
+    ~TableLockGuard();
+
+    TableLockGuard(const TableLockGuard&) = delete;
+    TableLockGuard& operator=(const TableLockGuard&) = delete;
+};
+
+#endif
@@ -1,11 +1,11 @@
 #include <iostream>
 #include <string>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <thread>
-#include <mutex>
 #include <nlohmann/json.hpp>
 #include <fstream>
 #include <sstream>
@@ -14,69 +14,70 @@
 #include "file.h"
 #include "Vector.h"
 #include "api.h"
+#include "snapshot.h"
+#include "httpstream.h"
+#include "orderbook.h"
+#include "sequencer.h"
+#include "accounts.h"
+#include "archive.h"
+#include "expiry.h"
+#include "orderindex.h"
+#include "lockingtable.h"
 
 using namespace std;
 using json = nlohmann::json;
 
-bool headersComplete(const string& data) {
-    for (size_t i = 0; i + 3 < data.size(); i++) {
-        if (data[i] == '\r' && data[i + 1] == '\n' && data[i + 2] == '\r' && data[i + 3] == '\n') {
-            return true;
+// Соединение без запросов дольше этого времени закрывается сервером
+const int KEEP_ALIVE_IDLE_SEC = 30;
+
+static size_t findHeadersEnd(const string& data) {
+    size_t pos = data.find("\r\n\r\n");
+    return pos == string::npos ? string::npos : pos + 4;
+}
+
+static bool headerIs(const string& line, const string& name) {
+    if (line.size() <= name.size() || line[name.size()] != ':') {
+        return false;
+    }
+    for (size_t i = 0; i < name.size(); i++) {
+        if (tolower((unsigned char)line[i]) != tolower((unsigned char)name[i])) {
+            return false;
         }
     }
-    return false;
+    return true;
 }
 
-void handleClient(int clientSocket, DatabaseManager& dbManager, mutex& dbMutex) {
-    char buffer[4096] = {0};
-    cerr << "[INFO] Клиент подключен." << endl;
-    string raw;
+static string headerValue(const string& line) {
+    size_t start = line.find_first_not_of(" \t", line.find(':') + 1);
+    return start == string::npos ? "" : line.substr(start);
+}
+
+// Читает очередной запрос соединения. В pending остаются байты, пришедшие сверх него:
+// клиент может отправить несколько запросов подряд, не дожидаясь ответов.
+static bool readRequest(int clientSocket, string& pending, string& head, string& body) {
+    char buffer[4096];
     ssize_t bytes;
 
-    bool headersFinished = false;
-    while ((bytes = recv(clientSocket, buffer, sizeof(buffer), 0)) > 0) {
-        raw.append(buffer, bytes);
-        if (headersComplete(raw)) {
-            headersFinished = true;
-            break;
+    size_t headersEnd;
+    while ((headersEnd = findHeadersEnd(pending)) == string::npos) {
+        bytes = recv(clientSocket, buffer, sizeof(buffer), 0);
+        if (bytes <= 0) {
+            return false;
         }
+        pending.append(buffer, bytes);
     }
-
-    if (raw.empty() || !headersFinished) {
-        close(clientSocket);
-        return;
-    }
-
-    stringstream ss(raw);
-    string requestLine;
-    getline(ss, requestLine);
-    if (!requestLine.empty() && requestLine.back() == '\r') {
-        requestLine.pop_back();
-    }
-
-    string method, path, http;
-    stringstream rl(requestLine);
-    rl >> method >> path >> http;
+    head = pending.substr(0, headersEnd);
 
     size_t contentLength = 0;
+    stringstream ss(head);
     string line;
-    while (true) {
-        if (!getline(ss, line)) {
-            break;
-        }
-
-        if (line.empty() || line == "\r") {
-            break;
-        }
+    while (getline(ss, line)) {
         if (!line.empty() && line.back() == '\r') {
             line.pop_back();
         }
-
-        if (line.size() > 15 && line.substr(0, 15) == "Content-Length:") {
+        if (headerIs(line, "Content-Length")) {
             try {
-                string lenStr = line.substr(15);
-                lenStr.erase(0, lenStr.find_first_not_of(" \t"));
-                contentLength = stoi(lenStr);
+                contentLength = stoul(headerValue(line));
             }
             catch (const exception& e) {
                 contentLength = 0;
@@ -84,41 +85,50 @@ void handleClient(int clientSocket, DatabaseManager& dbManager, mutex& dbMutex)
         }
     }
 
-    string body;
-    if (contentLength > 0) {
-        size_t headersEnd = 0;
-        bool found = false;
-        for (size_t i = 0; i + 3 < raw.size(); i++) {
-            if (raw[i] == '\r' && raw[i+1] == '\n' && 
-                raw[i+2] == '\r' && raw[i+3] == '\n') {
-                headersEnd = i + 4;
-                found = true;
-                break;
-            }
+    while (pending.size() < headersEnd + contentLength) {
+        bytes = recv(clientSocket, buffer, sizeof(buffer), 0);
+        if (bytes <= 0) {
+            return false;
         }
+        pending.append(buffer, bytes);
+    }
+    body = pending.substr(headersEnd, contentLength);
+    pending.erase(0, headersEnd + contentLength);
+    return true;
+}
 
-        if (found && raw.size() > headersEnd) {
-            body = raw.substr(headersEnd);
-        }
-        while (body.size() < contentLength) {
-            bytes = recv(clientSocket, buffer, sizeof(buffer), 0);
-            if (bytes <= 0) {
-                break;
-            }
-            body.append(buffer, bytes);
-        }
+// Обрабатывает один запрос. Возвращает false, если соединение после ответа нужно закрыть.
+static bool handleRequest(int clientSocket, DatabaseManager& dbManager, const string& head, const string& body) {
+    stringstream ss(head);
+    string requestLine;
+    getline(ss, requestLine);
+    if (!requestLine.empty() && requestLine.back() == '\r') {
+        requestLine.pop_back();
+    }
 
-        if (body.size() > contentLength) {
-            body.resize(contentLength);
-        }
+    string method, path, http;
+    stringstream rl(requestLine);
+    rl >> method >> path >> http;
+
+    string query;
+    size_t queryPos = path.find('?');
+    if (queryPos != string::npos) {
+        query = path.substr(queryPos + 1);
+        path = path.substr(0, queryPos);
     }
+    HashTable<string, string> params = parseQueryString(query);
+    bool pretty = queryFlag(params, "pretty");
+
+    // HTTP/1.1 держит соединение по умолчанию, HTTP/1.0 — только по явному keep-alive
+    bool keepAlive = http == "HTTP/1.1";
 
     string response;
+    shared_ptr<const string> cachedResponse;
+    bool streamed = false;
     {
-        string userKey;
-        stringstream header(raw);
+        string userKey, lastEventId, ifNoneMatch;
         string headerLine;
-        while (getline(header, headerLine)) {
+        while (getline(ss, headerLine)) {
             if (headerLine.empty() || headerLine == "\r") {
                 break;
             }
@@ -131,53 +141,114 @@ void handleClient(int clientSocket, DatabaseManager& dbManager, mutex& dbMutex)
                 while (!userKey.empty() && userKey[0] == ' ') {
                     userKey.erase(0, 1);
                 }
-                break;
+            }
+            else if (headerLine.size() > 14 && headerLine.substr(0, 14) == "Last-Event-ID:") {
+                lastEventId = headerLine.substr(14);
+                while (!lastEventId.empty() && lastEventId[0] == ' ') {
+                    lastEventId.erase(0, 1);
+                }
+            }
+            else if (headerIs(headerLine, "If-None-Match")) {
+                ifNoneMatch = headerValue(headerLine);
+            }
+            else if (headerIs(headerLine, "Connection")) {
+                string value = headerValue(headerLine);
+                for (char& c : value) {
+                    c = tolower((unsigned char)c);
+                }
+                if (value == "close") {
+                    keepAlive = false;
+                }
+                else if (value == "keep-alive") {
+                    keepAlive = true;
+                }
             }
         }
 
         if (method == "POST" && path == "/user") {
-            lock_guard<mutex> lock(dbMutex);
-            response = handleCreateUser(dbManager, body);
+            response = submitCommand(CommandType::CreateUser, body, userKey).get();
         } 
         else if (method == "GET" && path == "/lot") {
-            lock_guard<mutex> lock(dbMutex);
-            response = handleGetLots(dbManager);
+            cachedResponse = handleGetLots(dbManager, pretty, ifNoneMatch);
         }
         else if (method=="POST" && path=="/order") {
-            lock_guard<mutex> lock(dbMutex);
-            response = handleCreateOrder(dbManager, body, userKey);
+            response = submitCommand(CommandType::CreateOrder, body, userKey).get();
+        }
+        else if (method == "POST" && path == "/order/batch") {
+            response = handleCreateOrderBatch(dbManager, body, userKey);
+        }
+        else if (method == "GET" && path == "/order/mine") {
+            response = handleGetMyOrders(dbManager, userKey, params);
         }
         else if (method == "GET" && path == "/order") {
-            lock_guard<mutex> lock(dbMutex);
-            response = handleGetOrders(dbManager);
+            HttpStream stream(clientSocket);
+            handleGetOrders(dbManager, stream, params, ifNoneMatch);
+            streamed = true;
+            keepAlive = keepAlive && stream.ok();
+        }
+        else if (method == "GET" && path == "/trade") {
+            HttpStream stream(clientSocket);
+            handleGetTrades(dbManager, stream, params, ifNoneMatch);
+            streamed = true;
+            keepAlive = keepAlive && stream.ok();
+        }
+        else if (method == "GET" && path == "/orderbook") {
+            response = handleGetOrderBook(dbManager, params, ifNoneMatch);
+        }
+        else if (method == "GET" && path == "/feed") {
+            response = handleGetMarketFeed(dbManager, params);
+        }
+        else if (method == "GET" && path == "/feed/stream") {
+            // поток событий не имеет конца: соединение закрывается вместе с ним
+            handleMarketStream(dbManager, clientSocket, params, lastEventId);
+            streamed = true;
+            keepAlive = false;
+        }
+        else if (method == "GET" && path == "/engine") {
+            response = handleGetEngineStats(dbManager, pretty);
+        }
+        else if (method == "GET" && path == "/execution") {
+            response = handleGetExecutions(dbManager, userKey, params);
+        }
+        else if (method == "DELETE" && path == "/order/all") {
+            response = handleCancelAllOrders(dbManager, userKey, params);
         }
         else if (method=="DELETE" && path=="/order") {
-            lock_guard<mutex> lock(dbMutex);
-            response = handleDeleteOrder(dbManager, body, userKey);
+            response = submitCommand(CommandType::DeleteOrder, body, userKey).get();
+        }
+        else if (method == "PUT" && path == "/order") {
+            response = submitCommand(CommandType::AmendOrder, body, userKey).get();
         }
         else if (method == "GET" && path == "/pair") {
-            lock_guard<mutex> lock(dbMutex);
-            response = handleGetPairs(dbManager);
+            cachedResponse = handleGetPairs(dbManager, pretty, ifNoneMatch);
         }
         else if (method == "GET" && path == "/balance") {
-            lock_guard<mutex> lock(dbMutex);
-            response = handleGetBalance(dbManager, userKey);
+            response = handleGetBalance(dbManager, userKey, pretty, ifNoneMatch);
         }
         else {
-            response = "HTTP/1.1 404 Not Found\r\nContent-Type: application/json\r\n\r\n{\"error\":\"endpoint not found\"}";
+            response = makeHttpResponse(404, R"({"error":"endpoint not found"})");
         }
     }
 
-    ssize_t totalSent = 0;
-    ssize_t toSend = response.size();
+    const string& out = cachedResponse ? *cachedResponse : response;
+    if (!streamed && !sendAll(clientSocket, out.c_str(), out.size())) {
+        return false;
+    }
+    return keepAlive;
+}
 
-    while (totalSent < toSend) {
-        ssize_t sent = send(clientSocket, response.c_str() + totalSent, toSend - totalSent, 0);
-        if (sent <= 0) {
-            close(clientSocket);
-            return;
+void handleClient(int clientSocket, DatabaseManager& dbManager) {
+    cerr << "[INFO] Клиент подключен." << endl;
+
+    timeval idle{};
+    idle.tv_sec = KEEP_ALIVE_IDLE_SEC;
+    setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+
+    string pending, head, body;
+    while (readRequest(clientSocket, pending, head, body)) {
+        if (!handleRequest(clientSocket, dbManager, head, body)) {
+            break;
         }
-        totalSent += sent;
     }
 
     close(clientSocket);
@@ -188,10 +259,17 @@ int main() {
     ios::sync_with_stdio(false);
     freopen("server.log", "a", stderr);
     DatabaseManager dbManager;
-    mutex dbMutex;
 
     try {
         initCryptoDatabase(dbManager);
+        loadSnapshot(dbManager);
+        loadOrderBooks(dbManager);
+        loadOrderIndex(dbManager);
+        loadOrderExpiries(dbManager);
+        loadLedger(dbManager);
+        checkpointLedger(dbManager);
+        startLedgerCheckpoints(dbManager);
+        startOrderArchiver(dbManager);
     }
     catch (const exception& e) {
         cerr << "Ошибка инициализации биржи.\n";
@@ -200,6 +278,8 @@ int main() {
 
     int serverPort = 7432; // по умолчанию
     string serverIP = "127.0.0.1";
+    size_t engineShards = DEFAULT_ENGINE_SHARDS;
+    HashTable<string, int> shardMap;
     ifstream cfgFile("config.json");
     if (cfgFile.is_open()) {
         try {
@@ -207,6 +287,20 @@ int main() {
             cfgFile >> cfg;
             serverPort = cfg.at("database_port").get<int>();
             serverIP = cfg.at("database_ip").get<string>();
+
+            // необязательные: число движков и явное закрепление пар за движками {"pair_id": shard}
+            if (cfg.contains("engine_shards")) {
+                engineShards = cfg["engine_shards"].get<size_t>();
+            }
+            if (cfg.contains("engine_shard_map")) {
+                for (auto& item : cfg["engine_shard_map"].items()) {
+                    shardMap.insert(item.key(), item.value().get<int>());
+                }
+            }
+            // flock на файлах <table>_lock нужен, только если схему открывают и другие процессы
+            if (cfg.contains("file_locking")) {
+                setFileLocking(cfg["file_locking"].get<bool>());
+            }
         }
         catch (const exception& e) {
             cout << "Ошибка json. Порт и адрес по умолчанию.\n";
@@ -218,6 +312,9 @@ int main() {
         serverIP = "127.0.0.1";
     }
 
+    startSequencer(dbManager, engineShards, shardMap);
+    startOrderExpiry();
+
     int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSocket < 0) {
         cerr << "Ошибка создания сокета" << endl;
@@ -264,7 +361,7 @@ int main() {
         
         cerr << "[INFO] Новое подключение: " << clientIP << ":" << clientPort << endl;
 
-        thread clientThread(handleClient, clientSkt, ref(dbManager), ref(dbMutex));
+        thread clientThread(handleClient, clientSkt, ref(dbManager));
         clientThread.detach();
     }
 
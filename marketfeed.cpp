@@ -0,0 +1,50 @@
+#include "marketfeed.h"
+#include "eventring.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+using namespace std;
+
+static mutex feedMtx;
+static condition_variable feedCv;
+static EventRing<MarketEvent> ring(MARKET_FEED_CAPACITY);
+
+unsigned long long publishMarketEvent(MarketEvent event) {
+    unsigned long long seq;
+    {
+        lock_guard<mutex> lock(feedMtx);
+        seq = ring.push(event);
+    }
+    feedCv.notify_all();
+    return seq;
+}
+
+unsigned long long marketFeedSequence() {
+    lock_guard<mutex> lock(feedMtx);
+    return ring.head();
+}
+
+// Собирает события пары (или всех пар при пустом pairId) с номерами больше since.
+// Если таких нет, ждет их до timeoutMs. lastSeq — номер, с которого клиенту продолжать.
+// Возвращает false, если часть событий после since уже вытеснена из буфера
+// (или since из будущего, например после перезапуска сервера): клиенту нужно заново запросить стакан.
+bool readMarketEvents(const string& pairId, unsigned long long since, size_t limit, int timeoutMs, Vector<MarketEvent>& events, unsigned long long& lastSeq) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    auto matches = [&](const MarketEvent& event) { return pairId.empty() || event.pairId == pairId; };
+    unique_lock<mutex> lock(feedMtx);
+
+    while (true) {
+        if (!ring.collect(since, limit, matches, events, lastSeq)) {
+            return false;
+        }
+        if (!events.empty()) {
+            return true;
+        }
+
+        since = lastSeq;
+        if (!feedCv.wait_until(lock, deadline, [&] { return ring.head() > since; })) {
+            return true;
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef MARKETFEED_H
+#define MARKETFEED_H
+
+#include <string>
+#include "Vector.h"
+
+using namespace std;
+
+// Изменение стакана: add — новая заявка, fill — исполнение (quantity — объем сделки,
+// remaining — остаток заявки), cancel — снятие заявки с остатком quantity,
+// amend — заявка изменена владельцем: price и quantity — новые цена и объем.
+struct MarketEvent {
+    unsigned long long seq = 0;
+    string pairId;
+    string type;
+    long long orderId = 0;
+    string side;
+    double price = 0;
+    double quantity = 0;
+    double remaining = 0;
+};
+
+// Сколько последних событий хранится для догоняющих клиентов
+const size_t MARKET_FEED_CAPACITY = 8192;
+
+unsigned long long publishMarketEvent(MarketEvent event);
+unsigned long long marketFeedSequence();
+bool readMarketEvents(const string& pairId, unsigned long long since, size_t limit, int timeoutMs, Vector<MarketEvent>& events, unsigned long long& lastSeq);
+
+#endif
@@ -0,0 +1,290 @@
+#include "orderbook.h"
+#include "snapshot.h"
+#include "marketfeed.h"
+#include "hashtable.h"
+#include "Vector.h"
+#include <mutex>
+
+using namespace std;
+
+struct OrderLocation {
+    string pairId;
+    string type;
+    double price;
+};
+
+static mutex booksMtx;
+static HashTable<string, OrderBook> books;
+static HashTable<string, OrderLocation> orderLocations;
+
+Vector<BookOrder>& OrderBook::side(const string& type) {
+    return type == "buy" ? bids : asks;
+}
+
+const Vector<BookOrder>& OrderBook::getSide(const string& type) const {
+    return type == "buy" ? bids : asks;
+}
+
+void OrderBook::add(const string& type, const BookOrder& order) {
+    Vector<BookOrder>& orders = side(type);
+    bool isBuy = type == "buy";
+
+    size_t pos = 0;
+    while (pos < orders.get_size()) {
+        double price = orders[pos].price;
+        if (isBuy ? price < order.price : price > order.price) {
+            break;
+        }
+        pos++;
+    }
+    orders.insert(orders.begin() + pos, order);
+}
+
+bool OrderBook::updateQuantity(const string& type, long long orderId, double quantity) {
+    Vector<BookOrder>& orders = side(type);
+    for (size_t i = 0; i < orders.get_size(); i++) {
+        if (orders[i].orderId == orderId) {
+            orders[i].quantity = quantity;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool OrderBook::remove(const string& type, long long orderId) {
+    Vector<BookOrder>& orders = side(type);
+    for (size_t i = 0; i < orders.get_size(); i++) {
+        if (orders[i].orderId == orderId) {
+            orders.erase(orders.begin() + i);
+            return true;
+        }
+    }
+    return false;
+}
+
+Vector<PriceLevel> OrderBook::levels(const string& type, size_t depth) const {
+    const Vector<BookOrder>& orders = getSide(type);
+    Vector<PriceLevel> result;
+
+    for (size_t i = 0; i < orders.get_size(); i++) {
+        if (!result.empty() && result[result.get_size() - 1].price == orders[i].price) {
+            PriceLevel& level = result[result.get_size() - 1];
+            level.quantity += orders[i].quantity;
+            level.orders++;
+            continue;
+        }
+        if (result.get_size() >= depth) {
+            break;
+        }
+        result.push_back(PriceLevel{orders[i].price, orders[i].quantity, 1});
+    }
+    return result;
+}
+
+static void placeOrder(const string& orderId, const string& userId, const string& pairId, const string& type, double price, double quantity) {
+    if (!books.contains(pairId)) {
+        books.insert(pairId, OrderBook());
+    }
+
+    BookOrder order;
+    order.orderId = stoll(orderId);
+    order.userId = userId;
+    order.price = price;
+    order.quantity = quantity;
+
+    books.at(pairId).add(type, order);
+    orderLocations.insert(orderId, OrderLocation{pairId, type, price});
+}
+
+void loadOrderBooks(const DatabaseManager& DBmanager) {
+    int orderIdIdx = rowColumnIndex(DBmanager, "order", "order_id");
+    int userIdIdx = rowColumnIndex(DBmanager, "order", "user_id");
+    int pairIdIdx = rowColumnIndex(DBmanager, "order", "pair_id");
+    int quantityIdx = rowColumnIndex(DBmanager, "order", "quantity");
+    int priceIdx = rowColumnIndex(DBmanager, "order", "price");
+    int typeIdx = rowColumnIndex(DBmanager, "order", "type");
+    int closedIdx = rowColumnIndex(DBmanager, "order", "closed");
+
+    shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
+    Vector<Condition> cond;
+
+    lock_guard<mutex> lock(booksMtx);
+    scanSnapshot(DBmanager, *snapshot, "order", cond, [&](const Vector<string>& row) {
+        if (!row[closedIdx].empty()) {
+            return;
+        }
+        placeOrder(row[orderIdIdx], row[userIdIdx], row[pairIdIdx], row[typeIdx], stod(row[priceIdx]), stod(row[quantityIdx]));
+    });
+}
+
+// События ленты публикуются под booksMtx, поэтому их порядок совпадает с порядком изменений стакана
+void bookAddOrder(const string& orderId, const string& userId, const string& pairId, const string& type, double price, double quantity) {
+    lock_guard<mutex> lock(booksMtx);
+    placeOrder(orderId, userId, pairId, type, price, quantity);
+    publishMarketEvent(MarketEvent{0, pairId, "add", stoll(orderId), type, price, quantity, quantity});
+}
+
+void bookFillOrder(const string& orderId, double tradeQuantity, double tradePrice, double remaining) {
+    lock_guard<mutex> lock(booksMtx);
+    if (!orderLocations.contains(orderId)) {
+        return;
+    }
+    OrderLocation location = orderLocations.at(orderId);
+    if (remaining > 0) {
+        books.at(location.pairId).updateQuantity(location.type, stoll(orderId), remaining);
+    }
+    else {
+        books.at(location.pairId).remove(location.type, stoll(orderId));
+        orderLocations.erase(orderId);
+    }
+    publishMarketEvent(MarketEvent{0, location.pairId, "fill", stoll(orderId), location.type, tradePrice, tradeQuantity, remaining});
+}
+
+void bookCancelOrder(const string& orderId) {
+    lock_guard<mutex> lock(booksMtx);
+    if (!orderLocations.contains(orderId)) {
+        return;
+    }
+    OrderLocation location = orderLocations.at(orderId);
+    OrderBook& book = books.at(location.pairId);
+
+    double remaining = 0;
+    const Vector<BookOrder>& orders = book.getSide(location.type);
+    for (size_t i = 0; i < orders.get_size(); i++) {
+        if (orders[i].orderId == stoll(orderId)) {
+            remaining = orders[i].quantity;
+            break;
+        }
+    }
+
+    book.remove(location.type, stoll(orderId));
+    orderLocations.erase(orderId);
+    publishMarketEvent(MarketEvent{0, location.pairId, "cancel", stoll(orderId), location.type, location.price, remaining, 0});
+}
+
+// Уменьшение объема без смены цены сохраняет место заявки в очереди, иначе она встает в конец уровня новой цены
+bool bookAmendOrder(const string& orderId, double price, double quantity) {
+    lock_guard<mutex> lock(booksMtx);
+    if (!orderLocations.contains(orderId)) {
+        return false;
+    }
+    OrderLocation& location = orderLocations.at(orderId);
+    OrderBook& book = books.at(location.pairId);
+
+    const Vector<BookOrder>& orders = book.getSide(location.type);
+    BookOrder order;
+    bool found = false;
+    for (size_t i = 0; i < orders.get_size(); i++) {
+        if (orders[i].orderId == stoll(orderId)) {
+            order = orders[i];
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+    if (price == order.price && quantity <= order.quantity) {
+        book.updateQuantity(location.type, order.orderId, quantity);
+    }
+    else {
+        book.remove(location.type, order.orderId);
+        order.price = price;
+        order.quantity = quantity;
+        book.add(location.type, order);
+        location.price = price;
+    }
+    publishMarketEvent(MarketEvent{0, location.pairId, "amend", order.orderId, location.type, price, quantity, quantity});
+    return true;
+}
+
+bool bookFindOrder(const string& orderId, BookOrder& order, string& pairId, string& type) {
+    lock_guard<mutex> lock(booksMtx);
+    if (!orderLocations.contains(orderId)) {
+        return false;
+    }
+    const OrderLocation& location = orderLocations.at(orderId);
+    const Vector<BookOrder>& orders = books.at(location.pairId).getSide(location.type);
+    for (size_t i = 0; i < orders.get_size(); i++) {
+        if (orders[i].orderId == stoll(orderId)) {
+            order = orders[i];
+            pairId = location.pairId;
+            type = location.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+void bookForEachOrder(const function<void(const string& pairId, const string& type, const BookOrder& order)>& onOrder) {
+    lock_guard<mutex> lock(booksMtx);
+    for (size_t i = 0; i < books.getCapacity(); i++) {
+        Node<string, OrderBook>* node = books.getChain(i);
+        while (node != nullptr) {
+            const OrderBook& book = node->getValue();
+            for (const string& type : {string("buy"), string("sell")}) {
+                const Vector<BookOrder>& orders = book.getSide(type);
+                for (size_t j = 0; j < orders.get_size(); j++) {
+                    onOrder(node->getKey(), type, orders[j]);
+                }
+            }
+            node = node->getNext();
+        }
+    }
+}
+
+// Встречные заявки стороны type, цена которых пересекается с limitPrice, в порядке приоритета исполнения
+Vector<BookOrder> bookMatchCandidates(const string& pairId, const string& type, double limitPrice, double epsilon) {
+    lock_guard<mutex> lock(booksMtx);
+    Vector<BookOrder> result;
+    if (!books.contains(pairId)) {
+        return result;
+    }
+
+    const Vector<BookOrder>& orders = books.at(pairId).getSide(type);
+    for (size_t i = 0; i < orders.get_size(); i++) {
+        bool crosses = type == "sell" ? orders[i].price <= limitPrice + epsilon : orders[i].price >= limitPrice - epsilon;
+        if (!crosses) {
+            break;
+        }
+        result.push_back(orders[i]);
+    }
+    return result;
+}
+
+Vector<string> bookPairIds() {
+    lock_guard<mutex> lock(booksMtx);
+    Vector<string> ids;
+    for (size_t i = 0; i < books.getCapacity(); i++) {
+        Node<string, OrderBook>* node = books.getChain(i);
+        while (node != nullptr) {
+            ids.push_back(node->getKey());
+            node = node->getNext();
+        }
+    }
+
+    for (size_t i = 1; i < ids.get_size(); i++) {
+        for (size_t j = i; j > 0 && stoll(ids[j]) < stoll(ids[j - 1]); j--) {
+            swap(ids[j], ids[j - 1]);
+        }
+    }
+    return ids;
+}
+
+bool bookSnapshot(const string& pairId, size_t depth, Vector<PriceLevel>& bids, Vector<PriceLevel>& asks, int& bidOrders, int& askOrders, unsigned long long& seq) {
+    lock_guard<mutex> lock(booksMtx);
+    seq = marketFeedSequence();
+    if (!books.contains(pairId)) {
+        bidOrders = 0;
+        askOrders = 0;
+        return false;
+    }
+
+    const OrderBook& book = books.at(pairId);
+    bids = book.levels("buy", depth);
+    asks = book.levels("sell", depth);
+    bidOrders = book.getSide("buy").get_size();
+    askOrders = book.getSide("sell").get_size();
+    return true;
+}
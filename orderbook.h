@@ -0,0 +1,53 @@
+#ifndef ORDERBOOK_H
+#define ORDERBOOK_H
+
+#include <functional>
+#include <string>
+#include "Vector.h"
+#include "structures.h"
+
+using namespace std;
+
+struct BookOrder {
+    long long orderId = 0;
+    string userId;
+    double price = 0;
+    double quantity = 0;
+};
+
+struct PriceLevel {
+    double price = 0;
+    double quantity = 0;
+    int orders = 0;
+};
+
+// Открытые ордера одной пары. Заявки отсортированы по приоритету исполнения:
+// покупки по убыванию цены, продажи по возрастанию, при равной цене — по времени.
+class OrderBook {
+private:
+    Vector<BookOrder> bids;
+    Vector<BookOrder> asks;
+
+    Vector<BookOrder>& side(const string& type);
+
+public:
+    const Vector<BookOrder>& getSide(const string& type) const;
+
+    void add(const string& type, const BookOrder& order);
+    bool updateQuantity(const string& type, long long orderId, double quantity);
+    bool remove(const string& type, long long orderId);
+    Vector<PriceLevel> levels(const string& type, size_t depth) const;
+};
+
+void loadOrderBooks(const DatabaseManager& DBmanager);
+void bookAddOrder(const string& orderId, const string& userId, const string& pairId, const string& type, double price, double quantity);
+void bookFillOrder(const string& orderId, double tradeQuantity, double tradePrice, double remaining);
+void bookCancelOrder(const string& orderId);
+bool bookAmendOrder(const string& orderId, double price, double quantity);
+void bookForEachOrder(const function<void(const string& pairId, const string& type, const BookOrder& order)>& onOrder);
+bool bookFindOrder(const string& orderId, BookOrder& order, string& pairId, string& type);
+Vector<BookOrder> bookMatchCandidates(const string& pairId, const string& type, double limitPrice, double epsilon);
+Vector<string> bookPairIds();
+bool bookSnapshot(const string& pairId, size_t depth, Vector<PriceLevel>& bids, Vector<PriceLevel>& asks, int& bidOrders, int& askOrders, unsigned long long& seq);
+
+#endif
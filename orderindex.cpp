@@ -0,0 +1,121 @@
+#include "orderindex.h"
+#include "hashtable.h"
+#include "snapshot.h"
+#include <mutex>
+
+using namespace std;
+
+static mutex indexMtx;
+static HashTable<string, Vector<IndexedOrder>> ordersByUser;
+static HashTable<string, string> orderOwners;
+
+// Позиция заявки в списке пользователя: order_id растут, поэтому список отсортирован
+static long long findPosition(const Vector<IndexedOrder>& orders, long long orderId) {
+    size_t low = 0, high = orders.get_size();
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (orders[mid].orderId < orderId) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low < orders.get_size() && orders[low].orderId == orderId ? (long long)low : -1;
+}
+
+static void addOrder(const IndexedOrder& order) {
+    if (!ordersByUser.contains(order.userId)) {
+        ordersByUser.insert(order.userId, Vector<IndexedOrder>());
+    }
+    Vector<IndexedOrder>& orders = ordersByUser.at(order.userId);
+
+    size_t pos = orders.get_size();
+    while (pos > 0 && orders[pos - 1].orderId > order.orderId) {
+        pos--;
+    }
+    orders.insert(orders.begin() + pos, order);
+    orderOwners.insert(to_string(order.orderId), order.userId);
+}
+
+void loadOrderIndex(const DatabaseManager& dbManager) {
+    int orderIdIdx = rowColumnIndex(dbManager, "order", "order_id");
+    int userIdIdx = rowColumnIndex(dbManager, "order", "user_id");
+    int pairIdIdx = rowColumnIndex(dbManager, "order", "pair_id");
+    int quantityIdx = rowColumnIndex(dbManager, "order", "quantity");
+    int priceIdx = rowColumnIndex(dbManager, "order", "price");
+    int typeIdx = rowColumnIndex(dbManager, "order", "type");
+    int closedIdx = rowColumnIndex(dbManager, "order", "closed");
+
+    shared_ptr<const DatabaseSnapshot> snapshot = acquireSnapshot();
+    Vector<Condition> cond;
+
+    lock_guard<mutex> lock(indexMtx);
+    scanSnapshot(dbManager, *snapshot, "order", cond, [&](const Vector<string>& row) {
+        IndexedOrder order;
+        order.orderId = stoll(row[orderIdIdx]);
+        order.userId = row[userIdIdx];
+        order.pairId = row[pairIdIdx];
+        order.quantity = row[quantityIdx];
+        order.price = row[priceIdx];
+        order.type = row[typeIdx];
+        order.closed = row[closedIdx];
+        addOrder(order);
+    });
+}
+
+void indexAddOrder(const IndexedOrder& order) {
+    lock_guard<mutex> lock(indexMtx);
+    addOrder(order);
+}
+
+void indexUpdateOrder(const string& orderId, const Vector<string>& columns, const Vector<string>& values) {
+    lock_guard<mutex> lock(indexMtx);
+    if (!orderOwners.contains(orderId)) {
+        return;
+    }
+    Vector<IndexedOrder>& orders = ordersByUser.at(orderOwners.at(orderId));
+    long long pos = findPosition(orders, stoll(orderId));
+    if (pos < 0) {
+        return;
+    }
+
+    IndexedOrder& order = orders[pos];
+    for (size_t i = 0; i < columns.get_size(); i++) {
+        if (columns[i] == "quantity") order.quantity = values[i];
+        else if (columns[i] == "price") order.price = values[i];
+        else if (columns[i] == "closed") order.closed = values[i];
+    }
+}
+
+void indexRemoveOrders(const Vector<string>& orderIds) {
+    lock_guard<mutex> lock(indexMtx);
+    for (size_t i = 0; i < orderIds.get_size(); i++) {
+        if (!orderOwners.contains(orderIds[i])) {
+            continue;
+        }
+        Vector<IndexedOrder>& orders = ordersByUser.at(orderOwners.at(orderIds[i]));
+        long long pos = findPosition(orders, stoll(orderIds[i]));
+        if (pos >= 0) {
+            orders.erase(orders.begin() + pos);
+        }
+        orderOwners.erase(orderIds[i]);
+    }
+}
+
+Vector<IndexedOrder> indexUserOrders(const string& userId, const string& pairId, const string& status) {
+    lock_guard<mutex> lock(indexMtx);
+    Vector<IndexedOrder> result;
+    if (!ordersByUser.contains(userId)) {
+        return result;
+    }
+
+    const Vector<IndexedOrder>& orders = ordersByUser.at(userId);
+    for (size_t i = 0; i < orders.get_size(); i++) {
+        if (!pairId.empty() && orders[i].pairId != pairId) continue;
+        if (status == "open" && !orders[i].closed.empty()) continue;
+        if (status == "closed" && orders[i].closed.empty()) continue;
+        result.push_back(orders[i]);
+    }
+    return result;
+}
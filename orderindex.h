@@ -0,0 +1,31 @@
+#ifndef ORDERINDEX_H
+#define ORDERINDEX_H
+
+#include <string>
+#include "Vector.h"
+#include "structures.h"
+
+using namespace std;
+
+// Строка горячей таблицы order в том виде, в каком она записана в CSV
+struct IndexedOrder {
+    long long orderId = 0;
+    string userId;
+    string pairId;
+    string quantity;
+    string price;
+    string type;
+    string closed;
+};
+
+// Индекс order по user_id: заявки каждого пользователя в порядке order_id.
+// Повторяет горячую таблицу: строки добавляются при вставке, меняются вместе с CSV
+// и удаляются при переносе в архив.
+void loadOrderIndex(const DatabaseManager& dbManager);
+void indexAddOrder(const IndexedOrder& order);
+void indexUpdateOrder(const string& orderId, const Vector<string>& columns, const Vector<string>& values);
+void indexRemoveOrders(const Vector<string>& orderIds);
+// status: "" — все, "open" или "closed"; pairId пустой — все пары
+Vector<IndexedOrder> indexUserOrders(const string& userId, const string& pairId, const string& status);
+
+#endif
@@ -8,10 +8,11 @@
 
 using namespace std;
 
-RandomBot::RandomBot(const string& basename): running(false) {
+RandomBot::RandomBot(const string& basename): running(false), executionSeq(-1) {
     username = generateUsername(basename);
     try {
         userKey = api.createUser(username);
+        executionSeq = api.getExecutions()["seq"];
         cout << "[RANDOM] Пользователь создан: " << username << endl;
     }
     catch (const exception& e) {
@@ -84,13 +85,38 @@ void RandomBot::workerFunc() {
         }
 
         try {
-            auto balanceJson = api.getBalance();
+            uniform_int_distribution<size_t> pairDist(0, pairs.get_size() - 1);
+            size_t pairIdx = pairDist(rng);
+
+            int pairId = stoi(pairs[pairIdx].pairId);
+            int baseLotId = stoi(pairs[pairIdx].firstLotId);
+            int quoteLotId = stoi(pairs[pairIdx].secondLotId);
+
+            // баланс, отчеты и стакан выбранной пары запрашиваются одновременно
+            auto balanceFuture = api.getBalanceAsync();
+            auto reportsFuture = api.getExecutionsAsync(executionSeq);
+            auto bookFuture = api.getOrderBookAsync(pairId, 1);
+
+            auto balanceJson = balanceFuture.get();
+            auto reports = reportsFuture.get();
+            auto book = bookFuture.get();
             if (balanceJson.empty()) {
                 this_thread::sleep_for(chrono::milliseconds(50));
                 continue;
             }
 
-            auto ordersJson = api.getAllOrders();
+            // исполненные и снятые заявки убираются из списка по отчетам об исполнении
+            executionSeq = reports["seq"];
+            {
+                lock_guard<mutex> ordersLock(orderMtx);
+                if (!applyExecutionReports(reports, createdOrderId)) {
+                    // часть отчетов потеряна: список заново берется из открытых ордеров пользователя
+                    createdOrderId.clear();
+                    for (const auto& o : api.getMyOrders(-1, "open")) {
+                        createdOrderId.push_back(o["order_id"].get<int>());
+                    }
+                }
+            }
 
             if (deleteChanceDist(rng) <= 0.1 && createdOrderId.get_size() > 0) {
                 try {
@@ -103,86 +129,31 @@ void RandomBot::workerFunc() {
                     }
 
                     int orderId = createdOrderId[index];
-
-                    bool isOpen = false;
-                    for (const auto& order: ordersJson) {
-                        if (order["order_id"] == orderId) {
-                            string closed = order["closed"];
-                            bool isClosed = false;
-                            for (char c: closed) {
-                                if (!isspace(static_cast<unsigned char>(c))) {
-                                    isClosed = true;
-                                    break;
-                                }
-                            }
-                            isOpen = !isClosed;
-                            break;
-                        }
-                    }
-
-                    if (!isOpen) {
-                        int* ptr = &createdOrderId[index];
-                        {
-                            lock_guard<mutex> ordersLock(orderMtx);
-                            createdOrderId.erase(ptr);
-                        }
-                        cout << "[RANDOM] Попытка удалить закрытый ордер. Пользователь " << username << ", ордер " << orderId << endl; 
-                    }
-                    else {
-                        api.deleteOrder(orderId);
-                        int* ptr = &createdOrderId[index];
-                        {
-                            lock_guard<mutex> ordersLock(orderMtx);
-                            createdOrderId.erase(ptr);
-                        }
-                        cout << "[RANDOM] Удален ордер " << orderId << ", пользователь " << username << endl;
+                    api.deleteOrder(orderId);
+                    int* ptr = &createdOrderId[index];
+                    {
+                        lock_guard<mutex> ordersLock(orderMtx);
+                        createdOrderId.erase(ptr);
                     }
+                    cout << "[RANDOM] Удален ордер " << orderId << ", пользователь " << username << endl;
                 }
                 catch (const exception& e) {
                     cerr << "[RANDOM] Ошибка при удалении ордера пользователем " << username << ", ошибка: " << e.what() << endl;
                 }
             }
 
-            uniform_int_distribution<size_t> pairDist(0, pairs.get_size() - 1);
-            size_t pairIdx = pairDist(rng);
-
-            int pairId = stoi(pairs[pairIdx].pairId);
-            int baseLotId = stoi(pairs[pairIdx].firstLotId);
-            int quoteLotId = stoi(pairs[pairIdx].secondLotId);
-
             bool hasBuy = false;
             bool hasSell = false;
             double bestBuy = 0.0;
             double bestSell = 0.0;
 
-            for (const auto& order: ordersJson) {
-                string closed = order["closed"];
-                bool isClosed = false;
-                for (char c: closed) {
-                    if (!isspace(static_cast<unsigned char>(c))) {
-                        isClosed = true;
-                        break;
-                    }
-                }
-                if (isClosed || order["pair_id"] != pairId) {
-                    continue;
-                }
-
-                double price = order["price"];
-                string type = order["type"];
-
-                if (type == "buy") {
-                    if (!hasBuy || price > bestBuy) {
-                        bestBuy = price;
-                        hasBuy = true;
-                    }
-                }
-                if (type == "sell") {
-                    if (!hasSell || price < bestSell) {
-                        bestSell = price;
-                        hasSell = true;
-                    }
-                }
+            if (!book["bids"].empty()) {
+                bestBuy = book["bids"][0]["price"];
+                hasBuy = true;
+            }
+            if (!book["asks"].empty()) {
+                bestSell = book["asks"][0]["price"];
+                hasSell = true;
             }
 
             double marketPrice = 1.0;
@@ -261,10 +232,6 @@ void RandomBot::workerFunc() {
             }
 
             int orderId = api.createOrder(pairId, quantity, price, orderType);
-            {
-                lock_guard<mutex> ordersLock(orderMtx);
-                createdOrderId.push_back(orderId);
-            }
             cout << "[RANDOM] Создан ордер " << orderId << ", " << orderType << ". Пара: " << pairId << ", цена: " << price << ", объем: " << quantity << endl; 
         }
         catch (const exception& e) {
@@ -19,6 +19,7 @@ private:
     string userKey;
     atomic<bool> running;
     Vector<int> createdOrderId;
+    long long executionSeq;
     thread workerThread;
     mutex mtx;
     mutex orderMtx;
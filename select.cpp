@@ -20,7 +20,8 @@ void processLevel(
     const Vector<string>& tableNames,
     const Vector<Vector<string>>& tableColumns,
     const Vector<string>& selectColumns,
-    const Vector<Condition>& conditions
+    const Vector<Condition>& conditions,
+    ostream& out
 ) {
     if (level == tableCount) {
         Vector<string> fullColumns;
@@ -57,13 +58,13 @@ void processLevel(
         for (size_t si = 0; si < selectColumns.get_size(); ++si) {
             int idx = columnIndex(fullColumns, selectColumns[si]);
             if (idx >= 0 && idx < (int)fullValues.get_size()) {
-                cout << fullValues[idx];
+                out << fullValues[idx];
             }
             if (si + 1 < selectColumns.get_size()) {
-                cout << ",";
+                out << ",";
             }
         }
-        cout << "\n";
+        out << "\n";
         return;
     }
 
@@ -110,7 +111,7 @@ void processLevel(
             }
         }
 
-        processLevel(level + 1, tableCount, files, fileIndex, fileEnded, rowBuffers, schema, tableNames, tableColumns, selectColumns, conditions);
+        processLevel(level + 1, tableCount, files, fileIndex, fileEnded, rowBuffers, schema, tableNames, tableColumns, selectColumns, conditions, out);
     }
 }
 
@@ -119,7 +120,8 @@ void selectData(
     DatabaseManager& DBmanager,
     const Vector<string>& selectColumns,
     const Vector<string>& tableNames,
-    const Vector<Condition>& conditions
+    const Vector<Condition>& conditions,
+    ostream& out
 ) {
     const string schema = DBmanager.getSchemaName();
     int tableCount = tableNames.get_size();
@@ -159,7 +161,7 @@ void selectData(
 
     Vector<Vector<string>> rowBuffers(tableCount);
 
-    processLevel(0, tableCount, files, fileIndex, fileEnded, rowBuffers, schema, tableNames, tableColumns, selectColumns, conditions);
+    processLevel(0, tableCount, files, fileIndex, fileEnded, rowBuffers, schema, tableNames, tableColumns, selectColumns, conditions, out);
 
     for (int i = 0; i < tableCount; ++i) {
         if (files[i]) { 
@@ -172,11 +174,8 @@ void selectData(
 
 void selectDataCapture(DatabaseManager& DBmanager, const Vector<string>& selectColumns, const Vector<string>& tableNames, const Vector<Condition>& conditions, Vector<string>& output) {
     stringstream buff;
-    auto oldBuff = cout.rdbuf(buff.rdbuf());
+    selectData(DBmanager, selectColumns, tableNames, conditions, buff);
 
-    selectData(DBmanager, selectColumns, tableNames, conditions);
-
-    cout.rdbuf(oldBuff);
     string line;
     while (getline(buff, line)) {
         if (!line.empty()) {
@@ -1,10 +1,11 @@
 #ifndef SELECT_H
 #define SELECT_H
 
+#include <iostream>
 #include "Vector.h"
 #include "structures.h"
 
-void selectData(DatabaseManager& DBmanager, const Vector<string>& selectColumns, const Vector<string>& tableNames, const Vector<Condition>& conditions);
+void selectData(DatabaseManager& DBmanager, const Vector<string>& selectColumns, const Vector<string>& tableNames, const Vector<Condition>& conditions, ostream& out = cout);
 void selectDataCapture(DatabaseManager& DBmanager, const Vector<string>& selectColumns, const Vector<string>& tableNames, const Vector<Condition>& conditions, Vector<string>& output);
 
 #endif
\ No newline at end of file
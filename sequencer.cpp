@@ -0,0 +1,243 @@
+#include "sequencer.h"
+#include "api.h"
+#include "auxiliary.h"
+#include "orderbook.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+CommandQueue::CommandQueue(size_t capacity) : mask(capacity - 1), tail(0), head(0) {
+    slots = new Slot[capacity];
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].sequence.store(i, memory_order_relaxed);
+        slots[i].command = nullptr;
+    }
+}
+
+CommandQueue::~CommandQueue() {
+    delete[] slots;
+}
+
+bool CommandQueue::tryPush(OrderCommand* command) {
+    size_t pos = tail.load(memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[pos & mask];
+        size_t sequence = slot.sequence.load(memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                slot.command = command;
+                slot.sequence.store(pos + 1, memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            return false; // очередь заполнена
+        }
+        else {
+            pos = tail.load(memory_order_relaxed);
+        }
+    }
+}
+
+OrderCommand* CommandQueue::tryPop() {
+    Slot& slot = slots[head & mask];
+    size_t sequence = slot.sequence.load(memory_order_acquire);
+    if (sequence != head + 1) {
+        return nullptr;
+    }
+
+    OrderCommand* command = slot.command;
+    slot.sequence.store(head + mask + 1, memory_order_release);
+    head++;
+    return command;
+}
+
+// Движок: своя очередь, свой поток и счетчики. Мьютекс нужен только для сна простаивающего потока.
+struct Engine {
+    CommandQueue queue;
+    atomic<bool> parked;
+    mutex parkMtx;
+    condition_variable parkCv;
+
+    atomic<unsigned long long> commands;
+    atomic<unsigned long long> batches;
+    atomic<unsigned long long> busyMicros;
+
+    Engine() : queue(COMMAND_QUEUE_CAPACITY), parked(false), commands(0), batches(0), busyMicros(0) {}
+};
+
+static Vector<Engine*> engines;
+static HashTable<string, int> pairShards;
+
+static string applyCommand(DatabaseManager& dbManager, OrderCommand& command) {
+    switch (command.type) {
+        case CommandType::CreateUser: return handleCreateUser(dbManager, command.body);
+        case CommandType::CreateOrder: return handleCreateOrder(dbManager, command.body, command.userKey);
+        case CommandType::CreateOrderBatch: return applyOrderBatch(dbManager, command.body);
+        case CommandType::DeleteOrder: return handleDeleteOrder(dbManager, command.body, command.userKey);
+        case CommandType::AmendOrder: return handleAmendOrder(dbManager, command.body, command.userKey);
+        case CommandType::CancelOrders: return applyCancelOrders(dbManager, command.body);
+    }
+    return makeHttpResponse(500, R"({"error": "Неизвестная команда"})");
+}
+
+// Команды применяются пачками: срез публикуется один раз на пачку, и только после этого
+// клиенты получают ответы (видят собственные изменения). Каждая команда держит beginCommand(),
+// чтобы срез, опубликованный другим движком, не застал ее на середине.
+static void engineLoop(DatabaseManager& dbManager, Engine& engine) {
+    Vector<OrderCommand*> batch;
+    Vector<string> responses;
+    int idleSpins = 0;
+
+    while (true) {
+        OrderCommand* command;
+        while (batch.get_size() < SEQUENCER_BATCH && (command = engine.queue.tryPop()) != nullptr) {
+            batch.push_back(command);
+        }
+
+        if (batch.empty()) {
+            if (++idleSpins < 1000) {
+                this_thread::yield();
+                continue;
+            }
+            // после установки флага очередь проверяется еще раз: команда, добавленная
+            // до этого момента, не будет ждать пробуждения
+            unique_lock<mutex> lock(engine.parkMtx);
+            engine.parked.store(true);
+            OrderCommand* late = engine.queue.tryPop();
+            if (late != nullptr) {
+                batch.push_back(late);
+            }
+            else {
+                engine.parkCv.wait_for(lock, chrono::milliseconds(100));
+            }
+            engine.parked.store(false);
+            idleSpins = 0;
+            continue;
+        }
+        idleSpins = 0;
+
+        auto started = chrono::steady_clock::now();
+        for (size_t i = 0; i < batch.get_size(); i++) {
+            shared_lock<shared_mutex> inCommand = beginCommand();
+            responses.push_back(applyCommand(dbManager, *batch[i]));
+        }
+        try {
+            publishTables(dbManager);
+        }
+        catch (const exception& e) {
+            cerr << "[ERROR] Срез таблиц не опубликован: " << e.what() << endl;
+        }
+        auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started);
+
+        engine.commands += batch.get_size();
+        engine.batches++;
+        engine.busyMicros += elapsed.count();
+
+        for (size_t i = 0; i < batch.get_size(); i++) {
+            batch[i]->completion.set_value(responses[i]);
+            delete batch[i];
+        }
+        batch.clear();
+        responses.clear();
+    }
+}
+
+void startSequencer(DatabaseManager& dbManager, size_t shardCount, const HashTable<string, int>& shardMap) {
+    if (shardCount == 0) {
+        shardCount = 1;
+    }
+
+    for (size_t i = 0; i < shardMap.getCapacity(); i++) {
+        const Node<string, int>* node = shardMap.getChain(i);
+        while (node != nullptr) {
+            if (node->getValue() >= 0 && (size_t)node->getValue() < shardCount) {
+                pairShards.insert(node->getKey(), node->getValue());
+            }
+            node = node->getNext();
+        }
+    }
+
+    for (size_t i = 0; i < shardCount; i++) {
+        engines.push_back(new Engine());
+        thread(engineLoop, ref(dbManager), ref(*engines[i])).detach();
+    }
+    cout << "Движков сопоставления: " << shardCount << endl;
+}
+
+size_t engineShardCount() {
+    return engines.get_size();
+}
+
+size_t shardForPair(const string& pairId) {
+    if (pairShards.contains(pairId)) {
+        return pairShards.at(pairId);
+    }
+    try {
+        return stoull(pairId) % engines.get_size();
+    }
+    catch (const exception& e) {
+        return 0;
+    }
+}
+
+// Движок выбирается по паре команды. Команды с неразборчивым телом или неизвестным ордером
+// уходят движку 0: он вернет клиенту ту же ошибку, что и раньше.
+static size_t routeCommand(CommandType type, const string& body) {
+    try {
+        if (type == CommandType::CreateOrder) {
+            json request = parseJsonBody(body);
+            if (hasField(request, "pair_id")) {
+                return shardForPair(to_string(request["pair_id"].get<int>()));
+            }
+        }
+        else if (type == CommandType::DeleteOrder || type == CommandType::AmendOrder) {
+            json request = parseJsonBody(body);
+            BookOrder order;
+            string pairId, orderType;
+            if (hasField(request, "order_id") && bookFindOrder(to_string(request["order_id"].get<int>()), order, pairId, orderType)) {
+                return shardForPair(pairId);
+            }
+        }
+    }
+    catch (const exception& e) {
+    }
+    return 0;
+}
+
+future<string> submitCommand(CommandType type, const string& body, const string& userKey) {
+    return submitCommand(routeCommand(type, body), type, body, userKey);
+}
+
+future<string> submitCommand(size_t shard, CommandType type, const string& body, const string& userKey) {
+    OrderCommand* command = new OrderCommand{type, body, userKey, promise<string>()};
+    future<string> result = command->completion.get_future();
+    Engine& engine = *engines[shard];
+
+    while (!engine.queue.tryPush(command)) {
+        this_thread::yield();
+    }
+    if (engine.parked.load()) {
+        lock_guard<mutex> lock(engine.parkMtx);
+        engine.parkCv.notify_one();
+    }
+    return result;
+}
+
+Vector<ShardStats> engineStats() {
+    Vector<ShardStats> stats;
+    for (size_t i = 0; i < engines.get_size(); i++) {
+        ShardStats shard;
+        shard.shard = i;
+        shard.commands = engines[i]->commands.load();
+        shard.batches = engines[i]->batches.load();
+        shard.busyMicros = engines[i]->busyMicros.load();
+        stats.push_back(shard);
+    }
+    return stats;
+}
@@ -0,0 +1,75 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <atomic>
+#include <future>
+#include <string>
+#include "Vector.h"
+#include "hashtable.h"
+#include "structures.h"
+
+using namespace std;
+
+enum class CommandType {
+    CreateUser,
+    CreateOrder,
+    CreateOrderBatch,
+    DeleteOrder,
+    AmendOrder,
+    CancelOrders
+};
+
+struct OrderCommand {
+    CommandType type;
+    string body;
+    string userKey;
+    promise<string> completion;
+};
+
+// Ограниченная очередь без блокировок: много производителей (потоки HTTP), один потребитель (движок).
+// Каждая ячейка хранит номер, по которому производитель и потребитель узнают, свободна она или занята.
+class CommandQueue {
+private:
+    struct Slot {
+        atomic<size_t> sequence;
+        OrderCommand* command;
+    };
+
+    Slot* slots;
+    size_t mask;
+    alignas(64) atomic<size_t> tail;
+    alignas(64) size_t head;
+
+public:
+    explicit CommandQueue(size_t capacity);
+    ~CommandQueue();
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    bool tryPush(OrderCommand* command);
+    OrderCommand* tryPop();
+};
+
+struct ShardStats {
+    size_t shard = 0;
+    unsigned long long commands = 0;
+    unsigned long long batches = 0;
+    unsigned long long busyMicros = 0;
+};
+
+// Емкость очереди команд каждого движка (степень двойки) и сколько команд движок применяет между публикациями среза
+const size_t COMMAND_QUEUE_CAPACITY = 4096;
+const size_t SEQUENCER_BATCH = 64;
+const size_t DEFAULT_ENGINE_SHARDS = 4;
+
+// Заявки пары всегда обрабатывает один и тот же движок: по shardMap, если пара там указана,
+// иначе pair_id % shardCount. Создание пользователей выполняет движок 0.
+void startSequencer(DatabaseManager& dbManager, size_t shardCount, const HashTable<string, int>& shardMap);
+size_t engineShardCount();
+size_t shardForPair(const string& pairId);
+future<string> submitCommand(CommandType type, const string& body, const string& userKey);
+// Команда для заданного движка: ее составил вызывающий, уже разложив заявки по движкам их пар
+future<string> submitCommand(size_t shard, CommandType type, const string& body, const string& userKey);
+Vector<ShardStats> engineStats();
+
+#endif
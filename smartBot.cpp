@@ -9,21 +9,16 @@
 
 using namespace std;
 
-SmartBot::SmartBot(const string& basename): running(false), rubLotId(-1) {
+SmartBot::SmartBot(const string& basename): running(false), rubLotId(-1), feedSeq(-1), booksStale(true), executionSeq(-1) {
     username = generateUsername(basename);
     try {
         userKey = api.createUser(username);
-        auto lots = api.getLots();
-        for (const auto& lot: lots) {
-            if (lot["name"] == "RUB") {
-                rubLotId = lot["lot_id"];
-                break;
-            }
-        }
+        rubLotId = api.lotIdByName("RUB");
 
         if (rubLotId == -1) {
             throw runtime_error("[SMART] Лот с названием RUB не найден.\n");
         }
+        executionSeq = api.getExecutions()["seq"];
 
         cout << "[SMART] Пользователь создан: " << username << " с балансом (в RUB): " << getRUBBalance() << endl;
     }
@@ -59,6 +54,17 @@ void SmartBot::stop() {
     running.store(false);
     if (workerThread.joinable()) {
         workerThread.join();
+
+        // котировки остановленного робота не должны оставаться в стакане
+        try {
+            Vector<int> cancelled = api.cancelAllOrders();
+            lock_guard<mutex> lock(mtx);
+            activeOrderIds.clear();
+            cout << "[SMART] Снято ордеров: " << cancelled.get_size() << endl;
+        }
+        catch (const exception& e) {
+            cerr << "[SMART] Не удалось снять ордера: " << e.what() << endl;
+        }
     }
     cout << "[SMART] Робот " << username << " остановлен.\n";
 }
@@ -71,13 +77,8 @@ void SmartBot::workerFunc() {
     while (running.load()) {
         try {
             iteration++;
-            auto allOrders = api.getAllOrders();
             cleanupOrders();
 
-            if (iteration % 7 == 0) {
-                cancelOldOrders();
-            }
-
             executeAlgorythm();
             if (iteration % 15 == 0) {
                 printStats();
@@ -85,49 +86,52 @@ void SmartBot::workerFunc() {
         }
         catch (const exception& e) {
             cerr << "[SMART] Ошибка при инициализации алгоритма работы робота " << username << ". Ошибка: " << e.what() << endl;
+            booksStale = true;
         }
         this_thread::sleep_for(chrono::milliseconds(1000));
+
+        try {
+            checkMarketChanges();
+        }
+        catch (const exception& e) {
+            booksStale = true;
+        }
     }
 }
 
-void SmartBot::analyzeMarket(int pairId, const json& orders, double& bestBuy, double& bestSell, int& buyCount, int& sellCount) const {
+// Стакан перезапрашивается только если по ленте с прошлой итерации пришли события
+void SmartBot::checkMarketChanges() {
+    if (booksStale) {
+        return;
+    }
+    auto feed = api.getMarketFeed(-1, feedSeq);
+    if (feed["reset"].get<bool>() || !feed["events"].empty()) {
+        booksStale = true;
+    }
+    feedSeq = feed["seq"];
+}
+
+void SmartBot::analyzeMarket(int pairId, const json& books, double& bestBuy, double& bestSell, int& buyCount, int& sellCount) const {
     bestBuy = 0;
     bestSell = 0;
     buyCount = 0;
     sellCount = 0;
 
-    for (const auto& order: orders) {
-        if (order["pair_id"] != pairId) {
-            continue;
-        }
-
-        string closed = order["closed"] ;
-        bool isClosed = false;
-        for (char c : closed) {
-            if (!isspace(static_cast<unsigned char>(c))) {
-                isClosed = true;
-                break;
-            }
-        }
-        if (isClosed) {
+    for (const auto& book: books) {
+        if (book["pair_id"] != pairId) {
             continue;
         }
 
-        string type = order["type"];
-        double price = order["price"];
+        buyCount = book["bid_orders"];
+        sellCount = book["ask_orders"];
 
-        if (type == "buy") {
-            buyCount++;
-            if (price > bestBuy) {
-                bestBuy = price;
-            }
+        if (!book["bids"].empty()) {
+            bestBuy = book["bids"][0]["price"];
         }
-        else if (type == "sell") {
-            sellCount++;
-            if (bestSell == 0 || price < bestSell) {
-                bestSell = price;
-            }
+        if (!book["asks"].empty()) {
+            bestSell = book["asks"][0]["price"];
         }
+        break;
     }
 }
 
@@ -153,19 +157,10 @@ double SmartBot::calculateSpread(int buyCount, int sellCount) const {
 
 double SmartBot::calculateSafeQuantity(int pairId, const string& type, double bestBuy, double bestSell, const json& balance) {
     try {
-        auto pairs = api.getPairs();
         int saleLot = -1;
         int buyLot = -1;
 
-        for (const auto& p: pairs) {
-            if (p["pair_id"] == pairId) {
-                saleLot = p["sale_lot_id"];
-                buyLot = p["buy_lot_id"]; 
-                break;
-            }
-        }
-
-        if (saleLot == -1) {
+        if (!api.pairLots(pairId, saleLot, buyLot)) {
             cerr << "[SMART] Ошибка при получении пар: " << username << endl;
             return 0;
         }
@@ -213,9 +208,28 @@ double SmartBot::calculateSafeQuantity(int pairId, const string& type, double be
 }
 
 void SmartBot::executeAlgorythm() {
-    auto balance = api.getBalance();
-    auto pairs = api.getPairs();
-    auto orders = api.getActiveOrder(-1);
+    // баланс, пары и стакан запрашиваются одновременно
+    auto balanceFuture = api.getBalanceAsync();
+    auto pairsFuture = api.getPairsAsync();
+    future<json> booksFuture;
+    if (booksStale) {
+        booksFuture = api.getOrderBookAsync(-1, 1);
+    }
+
+    auto balance = balanceFuture.get();
+    auto pairs = pairsFuture.get();
+    if (booksFuture.valid()) {
+        books = booksFuture.get();
+        // лента читается с самого раннего номера среди стаканов: лишние события только пометят их устаревшими
+        feedSeq = -1;
+        for (const auto& book: books) {
+            long long seq = book["seq"];
+            if (feedSeq < 0 || seq < feedSeq) {
+                feedSeq = seq;
+            }
+        }
+        booksStale = false;
+    }
 
     struct Opportunity {
         int pairId;
@@ -226,14 +240,13 @@ void SmartBot::executeAlgorythm() {
     };
 
     Vector<Opportunity> opportunities;
-    double currentRUB = getRUBBalance();
 
     for (const auto& p : pairs) {
         int pairId = p["pair_id"];
         double bestBuy = 0, bestSell = 0;
         int buyCount = 0, sellCount = 0;
 
-        analyzeMarket(pairId, orders, bestBuy, bestSell, buyCount, sellCount);
+        analyzeMarket(pairId, books, bestBuy, bestSell, buyCount, sellCount);
 
         if (bestBuy <= 0 && bestSell <= 0) {
             continue;
@@ -266,58 +279,46 @@ void SmartBot::executeAlgorythm() {
     }
 
     if (opportunities.get_size() > 0) {
-        Opportunity best = opportunities[0];
+        // все котировки тика уходят одной пачкой, самые выгодные первыми: заявки, на которые
+        // уже не хватит средств, сервер отклонит по отдельности. Котировки выставляются как GTT
+        // и снимаются сервером по сроку, поэтому отдельно отменять устаревшие не нужно.
+        // Заявки попадут в activeOrderIds из отчетов об исполнении (accepted или partial)
         for (size_t i = 1; i < opportunities.get_size(); i++) {
-            if (opportunities[i].expectedRUBProfit > best.expectedRUBProfit) {
-                best = opportunities[i];
+            for (size_t j = i; j > 0 && opportunities[j].expectedRUBProfit > opportunities[j - 1].expectedRUBProfit; j--) {
+                swap(opportunities[j], opportunities[j - 1]);
             }
         }
 
-        int id = api.createOrder(best.pairId, best.quantity, best.price, best.type);
-        lock_guard<mutex> lock(mtx);
-        activeOrderIds.push_back(id);
+        long long expireAt = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count() + QUOTE_TTL_SEC;
+        json orders = json::array();
+        for (size_t i = 0; i < opportunities.get_size(); i++) {
+            const Opportunity& o = opportunities[i];
+            orders.push_back({{"pair_id", o.pairId}, {"quantity", o.quantity}, {"price", o.price}, {"type", o.type},
+                              {"time_in_force", "GTT"}, {"expire_at", expireAt}});
+        }
+        api.createOrders(orders);
     }
 }
 
 void SmartBot::cleanupOrders() {
-    auto orders = api.getAllOrders();
-    Vector<int> stillActive;
-
+    auto feed = api.getExecutions(executionSeq);
     {
         lock_guard<mutex> lock(mtx);
-        for (int id : activeOrderIds) {
-            bool open = false;
-            for (const auto& o : orders) {
-                if (o["order_id"] == id) {
-                    string closed = o["closed"];
-                    open = closed.empty();
-                    break;
-                }
-            }
-            if (open) {
-                stillActive.push_back(id);
-            }
+        executionSeq = feed["seq"];
+        if (applyExecutionReports(feed, activeOrderIds)) {
+            return;
         }
     }
-    {
-        lock_guard<mutex> lock(mtx);
-        activeOrderIds = stillActive;
-    }
-}
 
-void SmartBot::cancelOldOrders() {
-    int id = -1;
-    {
-        lock_guard<mutex> lock(mtx);
-        if (activeOrderIds.get_size() == 0) return;
-        id = activeOrderIds[0];
+    // часть отчетов потеряна: список заново берется из открытых ордеров пользователя
+    auto orders = api.getMyOrders(-1, "open");
+    Vector<int> stillActive;
+    for (const auto& o : orders) {
+        stillActive.push_back(o["order_id"].get<int>());
     }
-
-    if (api.deleteOrder(id)) {
+    {
         lock_guard<mutex> lock(mtx);
-        if (activeOrderIds.get_size() > 0 && activeOrderIds[0] == id) {
-            activeOrderIds.erase(&activeOrderIds[0]);
-        }
+        activeOrderIds = stillActive;
     }
 }
 
@@ -11,6 +11,8 @@
 using namespace std;
 using json = nlohmann::json;
 const double MIN_PROFIT = 0.002;
+// Сколько секунд котировка робота стоит в стакане до снятия сервером
+const long long QUOTE_TTL_SEC = 7;
 
 class SmartBot {
 private:
@@ -22,17 +24,21 @@ private:
     thread workerThread;
     Vector<int> activeOrderIds;
     mutex mtx;
+    json books;
+    long long feedSeq;
+    bool booksStale;
+    long long executionSeq;
 
     void workerFunc();
     void executeAlgorythm();
-    void analyzeMarket(int pairId, const json& orders, double& bestBuy, double& bestSell, int& buyCount, int& sellCount) const;
+    void checkMarketChanges();
+    void analyzeMarket(int pairId, const json& books, double& bestBuy, double& bestSell, int& buyCount, int& sellCount) const;
     
     double calculateSpread(int buyCount, int sellCount) const;
     double calculateSafeQuantity(int pairId, const string& type, double bestBuy, double bestSell, const json& balance);
     double getRUBBalance();
 
     void cleanupOrders();
-    void cancelOldOrders();
     string generateUsername(const string& basename);
 
 public:
@@ -0,0 +1,239 @@
+#include "snapshot.h"
+#include "structures.h"
+#include "auxiliary.h"
+#include "filter.h"
+#include "Vector.h"
+#include <fstream>
+#include <cstdlib>
+#include <mutex>
+
+using namespace std;
+
+static shared_ptr<const DatabaseSnapshot> currentSnapshot = make_shared<DatabaseSnapshot>();
+static mutex publishMtx;
+static mutex dirtyMtx;
+static Vector<string> dirtyTables;
+static Vector<int> dirtyChunks;
+
+const TableSnapshot* DatabaseSnapshot::find(const string& tableName) const {
+    for (size_t i = 0; i < tableNames.get_size(); i++) {
+        if (tableNames[i] == tableName) {
+            return tables[i].get();
+        }
+    }
+    return nullptr;
+}
+
+static shared_ptr<const TableChunk> loadChunk(const string& csvPath) {
+    ifstream in(csvPath);
+    if (!in.is_open()) {
+        return nullptr;
+    }
+
+    auto chunk = make_shared<TableChunk>();
+    string line;
+    if (getline(in, line)) {
+        chunk->header = splitCSV(line);
+    }
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        chunk->rows.push_back(splitCSV(line));
+
+        long long id = atoll(chunk->rows[chunk->rows.get_size() - 1][0].c_str());
+        if (id > chunk->maxId) {
+            chunk->maxId = id;
+        }
+    }
+    return chunk;
+}
+
+static shared_ptr<TableSnapshot> loadTable(const string& schema, const string& tableName) {
+    auto table = make_shared<TableSnapshot>();
+    int fileIndex = 1;
+    while (true) {
+        string csvPath = schema + "/" + tableName + "/" + to_string(fileIndex) + ".csv";
+        shared_ptr<const TableChunk> chunk = loadChunk(csvPath);
+        if (!chunk) break;
+        table->chunks.push_back(chunk);
+        fileIndex++;
+    }
+    return table;
+}
+
+void loadSnapshot(const DatabaseManager& DBmanager) {
+    lock_guard<mutex> lock(publishMtx);
+
+    auto snapshot = make_shared<DatabaseSnapshot>();
+    const auto& tableHash = DBmanager.getTables();
+
+    for (size_t i = 0; i < tableHash.getCapacity(); i++) {
+        Node<string, DBtable>* node = tableHash.getChain(i);
+        while (node != nullptr) {
+            const string& tableName = node->getKey();
+            snapshot->tableNames.push_back(tableName);
+            shared_ptr<TableSnapshot> table = loadTable(DBmanager.getSchemaName(), tableName);
+            table->version = DBmanager.getTableVersion(tableName);
+            snapshot->tables.push_back(table);
+            node = node->getNext();
+        }
+    }
+
+    {
+        lock_guard<mutex> dirtyLock(dirtyMtx);
+        dirtyTables.clear();
+        dirtyChunks.clear();
+    }
+    atomic_store(&currentSnapshot, shared_ptr<const DatabaseSnapshot>(snapshot));
+}
+
+void markChunkDirty(const string& tableName, int chunkIndex) {
+    lock_guard<mutex> lock(dirtyMtx);
+    for (size_t i = 0; i < dirtyTables.get_size(); i++) {
+        if (dirtyTables[i] == tableName && dirtyChunks[i] == chunkIndex) {
+            return;
+        }
+    }
+    dirtyTables.push_back(tableName);
+    dirtyChunks.push_back(chunkIndex);
+}
+
+void publishSnapshot(const DatabaseManager& DBmanager) {
+    lock_guard<mutex> lock(publishMtx);
+
+    Vector<string> tablesToReload;
+    Vector<int> chunksToReload;
+    {
+        lock_guard<mutex> dirtyLock(dirtyMtx);
+        tablesToReload = move(dirtyTables);
+        chunksToReload = move(dirtyChunks);
+        dirtyTables.clear();
+        dirtyChunks.clear();
+    }
+    if (tablesToReload.empty()) {
+        return;
+    }
+
+    shared_ptr<const DatabaseSnapshot> old = atomic_load(&currentSnapshot);
+    auto snapshot = make_shared<DatabaseSnapshot>(*old);
+
+    for (size_t t = 0; t < snapshot->tableNames.get_size(); t++) {
+        const string& tableName = snapshot->tableNames[t];
+        shared_ptr<TableSnapshot> table;
+
+        for (size_t d = 0; d < tablesToReload.get_size(); d++) {
+            if (tablesToReload[d] != tableName) continue;
+
+            if (!table) {
+                table = make_shared<TableSnapshot>(*snapshot->tables[t]);
+                // публикация идет под блокировками хранилища: версия соответствует содержимому чанков
+                table->version = DBmanager.getTableVersion(tableName);
+            }
+
+            int chunkIndex = chunksToReload[d];
+            string csvPath = DBmanager.getSchemaName() + "/" + tableName + "/" + to_string(chunkIndex) + ".csv";
+            shared_ptr<const TableChunk> chunk = loadChunk(csvPath);
+            if (!chunk) {
+                chunk = make_shared<TableChunk>();
+            }
+
+            while (table->chunks.get_size() < (size_t)chunkIndex) {
+                table->chunks.push_back(make_shared<TableChunk>());
+            }
+            table->chunks[chunkIndex - 1] = chunk;
+        }
+
+        if (table) {
+            snapshot->tables[t] = table;
+        }
+    }
+
+    atomic_store(&currentSnapshot, shared_ptr<const DatabaseSnapshot>(snapshot));
+}
+
+shared_ptr<const DatabaseSnapshot> acquireSnapshot() {
+    return atomic_load(&currentSnapshot);
+}
+
+static Vector<string> fullColumnNames(const DatabaseManager& DBmanager, const string& tableName) {
+    const Vector<string>& tableColumns = DBmanager.getTable(tableName).getColumns();
+
+    Vector<string> fullColumns;
+    fullColumns.push_back(tableName + "." + tableName + "_id");
+    for (size_t ci = 0; ci < tableColumns.get_size(); ci++) {
+        fullColumns.push_back(tableName + "." + tableColumns[ci]);
+    }
+    return fullColumns;
+}
+
+int rowColumnIndex(const DatabaseManager& DBmanager, const string& tableName, const string& column) {
+    return columnIndex(fullColumnNames(DBmanager, tableName), tableName + "." + column);
+}
+
+// Обход строк с первичным ключом больше afterId; чанки, где все ключи не больше afterId, пропускаются целиком.
+// Обход прекращается, когда onRow возвращает false.
+void scanSnapshotRange(const DatabaseManager& DBmanager, const DatabaseSnapshot& snapshot, const string& tableName, long long afterId, const function<bool(const Vector<string>& row)>& onRow) {
+    const TableSnapshot* table = snapshot.find(tableName);
+    if (table == nullptr) {
+        return;
+    }
+
+    size_t columnCount = DBmanager.getTable(tableName).getColumns().get_size() + 1;
+    Vector<string> fullValues(columnCount);
+
+    for (size_t c = 0; c < table->chunks.get_size(); c++) {
+        const TableChunk& chunk = *table->chunks[c];
+        if (afterId > 0 && chunk.maxId <= afterId) {
+            continue;
+        }
+
+        for (size_t r = 0; r < chunk.rows.get_size(); r++) {
+            const Vector<string>& row = chunk.rows[r];
+            if (afterId > 0 && atoll(row[0].c_str()) <= afterId) {
+                continue;
+            }
+
+            for (size_t vi = 0; vi < fullValues.get_size(); vi++) {
+                fullValues[vi] = vi < row.get_size() ? row[vi] : string();
+            }
+
+            if (!onRow(fullValues)) {
+                return;
+            }
+        }
+    }
+}
+
+void scanSnapshot(const DatabaseManager& DBmanager, const DatabaseSnapshot& snapshot, const string& tableName, const Vector<Condition>& conditions, const function<void(const Vector<string>& row)>& onRow) {
+    Vector<string> fullColumns = fullColumnNames(DBmanager, tableName);
+
+    scanSnapshotRange(DBmanager, snapshot, tableName, 0, [&](const Vector<string>& row) {
+        if (conditions.empty() || filterMatch(fullColumns, row, conditions)) {
+            onRow(row);
+        }
+        return true;
+    });
+}
+
+void selectSnapshotCapture(const DatabaseManager& DBmanager, const DatabaseSnapshot& snapshot, const Vector<string>& selectColumns, const string& tableName, const Vector<Condition>& conditions, Vector<string>& output) {
+    Vector<string> fullColumns = fullColumnNames(DBmanager, tableName);
+
+    Vector<int> selectIdx;
+    for (size_t si = 0; si < selectColumns.get_size(); si++) {
+        selectIdx.push_back(columnIndex(fullColumns, selectColumns[si]));
+    }
+
+    scanSnapshot(DBmanager, snapshot, tableName, conditions, [&](const Vector<string>& row) {
+        string line;
+        for (size_t si = 0; si < selectIdx.get_size(); si++) {
+            if (selectIdx[si] >= 0) {
+                line += row[selectIdx[si]];
+            }
+            if (si + 1 < selectIdx.get_size()) {
+                line += ",";
+            }
+        }
+        if (!line.empty()) {
+            output.push_back(line);
+        }
+    });
+}
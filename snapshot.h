@@ -0,0 +1,43 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include "Vector.h"
+#include "structures.h"
+
+using namespace std;
+
+// Содержимое одного CSV-чанка таблицы (N.csv) на момент публикации.
+struct TableChunk {
+    Vector<string> header;
+    Vector<Vector<string>> rows;
+    long long maxId = 0;
+};
+
+// Версия таблицы: неизменённые чанки разделяются между версиями (copy-on-write).
+struct TableSnapshot {
+    unsigned long version = 0;
+    Vector<shared_ptr<const TableChunk>> chunks;
+};
+
+// Согласованный срез всех таблиц. Читатели работают с ним без блокировок,
+// писатели публикуют новый срез после завершения своей операции.
+struct DatabaseSnapshot {
+    Vector<string> tableNames;
+    Vector<shared_ptr<const TableSnapshot>> tables;
+
+    const TableSnapshot* find(const string& tableName) const;
+};
+
+void loadSnapshot(const DatabaseManager& DBmanager);
+void markChunkDirty(const string& tableName, int chunkIndex);
+void publishSnapshot(const DatabaseManager& DBmanager);
+shared_ptr<const DatabaseSnapshot> acquireSnapshot();
+int rowColumnIndex(const DatabaseManager& DBmanager, const string& tableName, const string& column);
+void scanSnapshotRange(const DatabaseManager& DBmanager, const DatabaseSnapshot& snapshot, const string& tableName, long long afterId, const function<bool(const Vector<string>& row)>& onRow);
+void scanSnapshot(const DatabaseManager& DBmanager, const DatabaseSnapshot& snapshot, const string& tableName, const Vector<Condition>& conditions, const function<void(const Vector<string>& row)>& onRow);
+void selectSnapshotCapture(const DatabaseManager& DBmanager, const DatabaseSnapshot& snapshot, const Vector<string>& selectColumns, const string& tableName, const Vector<Condition>& conditions, Vector<string>& output);
+
+#endif
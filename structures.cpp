@@ -50,6 +50,10 @@ const HashTable<string, DBtable>& DatabaseManager::getTables() const {
     return tables;
 }
 
+HashTable<string, int>& DatabaseManager::getLockFDs() {
+    return lockFDs;
+}
+
 void DatabaseManager::setSchemaName(const string& s) {
     schemaName = s;
 }
@@ -68,4 +72,15 @@ DBtable& DatabaseManager::getTable(const string& name) {
 
 const DBtable& DatabaseManager::getTable(const string& name) const {
     return tables.at(name);
+}
+
+void DatabaseManager::bumpTableVersion(const string& name) {
+    lock_guard<mutex> lock(versionsMtx);
+    unsigned long version = tableVersions.contains(name) ? tableVersions.at(name) : 0;
+    tableVersions.insert(name, version + 1);
+}
+
+unsigned long DatabaseManager::getTableVersion(const string& name) const {
+    lock_guard<mutex> lock(versionsMtx);
+    return tableVersions.contains(name) ? tableVersions.at(name) : 0;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef STRUCTURES_H
 #define STRUCTURES_H
 
+#include <mutex>
 #include <string>
 #include "Vector.h"
 #include "hashtable.h"
@@ -29,6 +30,9 @@ private:
     int tuplesLimit;
     HashTable<std::string, DBtable> tables;
     HashTable<std::string, int> lockFDs;
+    // Версия таблицы растет при каждой записи в ее CSV (вставка, удаление, изменение строк)
+    HashTable<std::string, unsigned long> tableVersions;
+    mutable std::mutex versionsMtx;
 
 public:
     DatabaseManager();
@@ -39,6 +43,7 @@ public:
 
     HashTable<std::string, DBtable>& getTables();
     const HashTable<std::string, DBtable>& getTables() const;
+    HashTable<std::string, int>& getLockFDs();
 
     void setSchemaName(const std::string& s);
     void setTuplesLimit(int limit);
@@ -46,6 +51,9 @@ public:
     void addTable(const DBtable& table);
     DBtable& getTable(const std::string& name);
     const DBtable& getTable(const std::string& name) const;
+
+    void bumpTableVersion(const std::string& name);
+    unsigned long getTableVersion(const std::string& name) const;
 };
 
 struct Condition {
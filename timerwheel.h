@@ -0,0 +1,81 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <utility>
+#include "Vector.h"
+
+using namespace std;
+
+// Иерархическое колесо таймеров: LEVELS уровней по SLOTS ячеек, ячейка уровня l покрывает SLOTS^l тиков.
+// Таймер кладется на уровень, соответствующий расстоянию до срока, и при повороте старшего уровня
+// опускается ниже, поэтому постановка и срабатывание не зависят от числа таймеров.
+// Синхронизацию обеспечивает владелец колеса.
+template<typename T>
+class TimerWheel {
+private:
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 4;
+    static const unsigned long long SLOTS = 1ull << LEVEL_BITS;
+
+    struct Timer {
+        unsigned long long expires;
+        T value;
+    };
+
+    Vector<Timer> slots[LEVELS][SLOTS];
+    unsigned long long current;
+
+    void place(const Timer& timer) {
+        unsigned long long delta = timer.expires > current ? timer.expires - current : 0;
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (1ull << (LEVEL_BITS * (level + 1)))) {
+            level++;
+        }
+        // сроки за пределами старшего уровня попадают в ячейку, которая повернется раньше срока,
+        // и при повороте будут разложены заново
+        unsigned long long expires = timer.expires > current ? timer.expires : current + 1;
+        slots[level][(expires >> (LEVEL_BITS * level)) & (SLOTS - 1)].push_back(timer);
+    }
+
+public:
+    explicit TimerWheel(unsigned long long start = 0) : current(start) {}
+
+    unsigned long long now() const {
+        return current;
+    }
+
+    void schedule(unsigned long long expires, const T& value) {
+        place(Timer{expires, value});
+    }
+
+    // Продвигает время до to и добавляет в due значения таймеров, срок которых наступил
+    void advance(unsigned long long to, Vector<T>& due) {
+        while (current < to) {
+            current++;
+
+            for (int level = 1; level < LEVELS; level++) {
+                if ((current & ((1ull << (LEVEL_BITS * level)) - 1)) != 0) {
+                    break;
+                }
+                Vector<Timer> cascade;
+                swap(cascade, slots[level][(current >> (LEVEL_BITS * level)) & (SLOTS - 1)]);
+                for (size_t i = 0; i < cascade.get_size(); i++) {
+                    place(cascade[i]);
+                }
+            }
+
+            Vector<Timer> fired;
+            swap(fired, slots[0][current & (SLOTS - 1)]);
+            for (size_t i = 0; i < fired.get_size(); i++) {
+                if (fired[i].expires <= current) {
+                    due.push_back(fired[i].value);
+                }
+                else {
+                    place(fired[i]);
+                }
+            }
+        }
+    }
+};
+
+#endif